@@ -1,7 +1,35 @@
 #include <am.h>
+#include <nemu.h>
 #include <stdatomic.h>
 #include <klib-macros.h>
 
+#ifdef NEMU_SMP
+// secondary harts are started by the MPE controller of NEMU
+#define MAX_CPU    8
+#define STACK_SIZE (16 * 1024)
+
+static uint8_t mpe_stack[MAX_CPU][STACK_SIZE] __attribute__((aligned(16)));
+
+bool mpe_init(void (*entry)()) {
+  outl(MPE_ADDR, MAX_CPU); // only the harts with a stack are started
+  outl(MPE_ADDR + 4, (uintptr_t)mpe_stack);
+  outl(MPE_ADDR + 8, STACK_SIZE);
+  outl(MPE_ADDR + 12, (uintptr_t)entry);
+  entry();
+  panic("MPE entry returns");
+}
+
+int cpu_count() {
+  int n = inl(MPE_ADDR);
+  return (n < MAX_CPU ? n : MAX_CPU);
+}
+
+int cpu_current() {
+  int id;
+  asm volatile("csrr %0, mhartid" : "=r"(id));
+  return id;
+}
+#else
 bool mpe_init(void (*entry)()) {
   entry();
   panic("MPE entry returns");
@@ -14,6 +42,7 @@ int cpu_count() {
 int cpu_current() {
   return 0;
 }
+#endif
 
 int atomic_xchg(int *addr, int newval) {
   return atomic_exchange(addr, newval);
@@ -1,7 +1,12 @@
 include $(AM_HOME)/scripts/isa/riscv.mk
 include $(AM_HOME)/scripts/platform/nemu.mk
 CFLAGS  += -DISA_H=\"riscv/riscv.h\"
+# smp=1 starts the other harts of a NEMU with CONFIG_SMP, which needs the A extension
+ifeq ($(smp),1)
+COMMON_CFLAGS += -march=rv32ima_zicsr -mabi=ilp32 -DNEMU_SMP # overwrite
+else
 COMMON_CFLAGS += -march=rv32im_zicsr -mabi=ilp32  # overwrite
+endif
 LDFLAGS       += -melf32lriscv                     # overwrite
 
 AM_SRCS += riscv/nemu/start.S \
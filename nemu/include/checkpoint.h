@@ -0,0 +1,42 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#include <common.h>
+
+// A checkpoint is a stream of sections which are written and read in the
+// same order. Each part of the machine provides one function to save or
+// restore its state, which only calls the functions below, so the same
+// code is used for both directions.
+
+typedef struct Checkpoint Checkpoint;
+
+bool ckpt_saving(Checkpoint *c);
+void ckpt_data(Checkpoint *c, void *buf, size_t len);
+void ckpt_pages(Checkpoint *c, void *buf, size_t len);
+
+// A delta checkpoint only has the pages written since the last checkpoint
+// saved or loaded. It is restored by loading the chain of checkpoints in
+// order, or merged into a full checkpoint by tools/ckpt. The written pages
+// are only tracked after checkpoint_track_delta(), since the tracking
+// slows down the first write to each page.
+void checkpoint_track_delta();
+bool checkpoint_save(const char *file);
+bool checkpoint_save_delta(const char *file);
+bool checkpoint_load(const char *file);
+
+#endif
@@ -44,6 +44,16 @@ typedef MUXDEF(PMEM64, uint64_t, uint32_t) paddr_t;
 #define FMT_PADDR MUXDEF(PMEM64, "0x%016" PRIx64, "0x%08" PRIx32)
 typedef uint16_t ioaddr_t;
 
+// The state of a hart is thread-local when each hart runs in its own host
+// thread. As a library, each host thread runs its own machine, so the state
+// of the machine is thread-local as well.
+#if defined(CONFIG_SMP) || defined(CONFIG_TARGET_LIB)
+#define HART_LOCAL __thread
+#else
+#define HART_LOCAL
+#endif
+#define MACHINE_LOCAL MUXDEF(CONFIG_TARGET_LIB, __thread, )
+
 #include <debug.h>
 
 #endif
@@ -0,0 +1,46 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __CPU_AOT_H__
+#define __CPU_AOT_H__
+
+#include <isa.h>
+#include <memory/access.h>
+
+// at most this number of instructions are executed by a translated function
+// between two budget checks, this should match CHECK_INTERVAL in tools/aot
+#define AOT_CHECK_INTERVAL 32
+
+// A guest function translated by tools/aot. It executes from cpu.pc until
+// it leaves the function, reaches an instruction not translated, or has
+// executed `budget' instructions (plus at most AOT_CHECK_INTERVAL), then
+// returns the number of instructions executed with cpu.pc updated.
+typedef uint64_t (*aot_func_t)(uint64_t budget);
+
+typedef struct {
+  vaddr_t start, end;
+  aot_func_t func;
+  uint32_t hash; // of the instructions at translation time
+  const char *name;
+} AotFunc;
+
+extern const AotFunc aot_func[];
+extern const int aot_nr_func;
+
+void init_aot();
+aot_func_t aot_lookup(vaddr_t pc);
+void aot_statistic();
+
+#endif
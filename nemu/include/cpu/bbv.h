@@ -0,0 +1,30 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __CPU_BBV_H__
+#define __CPU_BBV_H__
+
+#include <common.h>
+
+// Basic-block vectors in the format of SimPoint: every interval of
+// instructions, the number of instructions executed in each basic block.
+
+extern bool bbv_enabled;
+
+void init_bbv(const char *file, uint64_t interval);
+void bbv_step(vaddr_t pc, vaddr_t dnpc, vaddr_t snpc, int nr_inst);
+void bbv_finish();
+
+#endif
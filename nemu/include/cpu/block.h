@@ -0,0 +1,54 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __CPU_BLOCK_H__
+#define __CPU_BLOCK_H__
+
+#include <cpu/idcache.h>
+
+#define BLOCK_MAX_INST 64
+
+// a hot trace compiled by LLVM, see hottrace.c
+typedef uint64_t (*hot_trace_t)(uint64_t budget);
+
+typedef struct Block {
+  vaddr_t pc;
+  int nr_inst;  // number of instructions decoded so far
+  bool done;    // the end of the block is found
+  // successors of the block, filled when leaving the block
+  struct { vaddr_t pc; struct Block *blk; } succ[2];
+  struct Block *next; // next block in the same hash bucket
+#ifdef CONFIG_HOT_TRACE
+  uint32_t count;     // number of executions
+  hot_trace_t trace;  // compiled trace starting from this block
+#endif
+  IDCacheEntry inst[BLOCK_MAX_INST];
+} Block;
+
+extern bool block_need_flush;
+
+Block* block_lookup(vaddr_t pc);
+Block* block_find(vaddr_t pc);
+Block* block_next(Block *b, vaddr_t pc);
+void block_flush();
+void block_release();
+void block_statistic();
+
+hot_trace_t hot_trace_compile(vaddr_t pc);
+void hot_trace_release();
+void hot_trace_statistic();
+
+#endif
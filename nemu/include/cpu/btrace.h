@@ -0,0 +1,46 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __CPU_BTRACE_H__
+#define __CPU_BTRACE_H__
+
+#include <common.h>
+
+// Binary instruction trace, decoded offline by tools/btrace.
+//
+// The file starts with the header below, followed by the initial values
+// of the GPRs if BTRACE_REGS is set. Each record is the pc and the raw
+// instruction (both 32-bit little-endian). With BTRACE_REGS, a count of
+// the GPRs written by the instruction follows, then a register number
+// (uint8_t) and its new value (32-bit) for each of them.
+
+#define BTRACE_MAGIC "NEMUBTRC"
+#define BTRACE_VERSION 1
+#define BTRACE_REGS 0x1
+
+typedef struct {
+  char magic[8];
+  uint32_t version, flags;
+  char isa[16];
+} BTraceHeader;
+
+struct Decode;
+extern bool btrace_enabled;
+
+void init_btrace(const char *file);
+void btrace_step(struct Decode *s);
+void btrace_finish();
+
+#endif
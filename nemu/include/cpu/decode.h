@@ -23,6 +23,11 @@ typedef struct Decode {
   vaddr_t snpc; // static next pc
   vaddr_t dnpc; // dynamic next pc
   ISADecodeInfo isa;
+  IFDEF(CONFIG_IDCACHE, struct IDCacheEntry *de); // entry in the decode cache
+  // set by the engine if the next instruction may be executed together,
+  // cleared by the ISA if it is not
+  IFDEF(CONFIG_INST_FUSION, bool fuse);
+  IFDEF(CONFIG_INST_COUNT, uint16_t pat); // id of the matched pattern, see cpu/inst-count.h
   IFDEF(CONFIG_ITRACE, char logbuf[128]);
 } Decode;
 
@@ -86,17 +91,73 @@ finish:
 }
 
 
+// --- pattern dispatch table ---
+// The patterns of a decode function are collected into a table when it
+// is executed for the first time, which only builds the table and does
+// not execute the instruction. Each ISA does this in isa_init_decode(),
+// called by init_isa() before any instruction is decoded. The table
+// groups the patterns into buckets by the bits which are fixed in most
+// patterns (e.g. opcode and funct3 in riscv32), so only a few candidates
+// are tested for each instruction, regardless of the number of patterns.
+#define INSTPAT_MAX 256
+#define INSTPAT_BUCKET_BITS 10
+
+typedef struct {
+  uint64_t key, mask;
+  const void *match; // the code to decode and execute this pattern
+  const char *name;
+} InstPat;
+
+typedef struct {
+  bool ready;
+  int nr_pat;
+  InstPat pat[INSTPAT_MAX]; // in the order of the table
+  int nr_field;
+  struct { uint8_t lo, len, pos; } field[INSTPAT_BUCKET_BITS];
+  uint32_t *bucket; // bucket i contains list[bucket[i] .. bucket[i + 1] - 1]
+  uint16_t *list;
+  const void *end;
+} InstPatTable;
+
+int instpat_add(InstPatTable *t, uint64_t key, uint64_t mask, uint64_t shift, const void *match, const char *name);
+void instpat_build(InstPatTable *t, const void *end);
+
+static inline const void* instpat_dispatch(InstPatTable *t, uint64_t inst) {
+  uint32_t idx = 0;
+  for (int i = 0; i < t->nr_field; i ++) {
+    idx |= BITS(inst, t->field[i].lo + t->field[i].len - 1, t->field[i].lo) << t->field[i].pos;
+  }
+  for (uint32_t j = t->bucket[idx]; j < t->bucket[idx + 1]; j ++) {
+    InstPat *p = &t->pat[t->list[j]];
+    if ((inst & p->mask) == p->key) return p->match;
+  }
+  return t->end;
+}
+
 // --- pattern matching wrappers for decode ---
-#define INSTPAT(pattern, ...) do { \
+#define INSTPAT(pattern, ...) __INSTPAT(__COUNTER__, pattern, ##__VA_ARGS__)
+#define __INSTPAT_NAME(name, ...) str(name)
+#define __INSTPAT(id, pattern, ...) do { \
   uint64_t key, mask, shift; \
+  IFDEF(CONFIG_INST_COUNT, static uint16_t __instpat_id); \
   pattern_decode(pattern, STRLEN(pattern), &key, &mask, &shift); \
-  if ((((uint64_t)INSTPAT_INST(s) >> shift) & mask) == key) { \
+  if (unlikely(!__instpat_table.ready)) { \
+    MUXDEF(CONFIG_INST_COUNT, __instpat_id =, ) instpat_add(&__instpat_table, key, mask, shift, \
+        &&concat(__instpat_match_, id), __INSTPAT_NAME(__VA_ARGS__)); \
+  } else if (0) { \
+    concat(__instpat_match_, id): \
+    IFDEF(CONFIG_INST_COUNT, s->pat = __instpat_id); \
     INSTPAT_MATCH(s, ##__VA_ARGS__); \
     goto *(__instpat_end); \
   } \
 } while (0)
 
-#define INSTPAT_START(name) { const void ** __instpat_end = &&concat(__instpat_end_, name);
-#define INSTPAT_END(name)   concat(__instpat_end_, name): ; }
+#define INSTPAT_START(name) { \
+  static const void *__instpat_end = &&concat(__instpat_end_, name); \
+  static InstPatTable __instpat_table = {}; \
+  if (likely(__instpat_table.ready)) goto *instpat_dispatch(&__instpat_table, INSTPAT_INST(s));
+#define INSTPAT_END(name) \
+  instpat_build(&__instpat_table, __instpat_end); \
+  concat(__instpat_end_, name): ; }
 
 #endif
@@ -0,0 +1,72 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __CPU_IDCACHE_H__
+#define __CPU_IDCACHE_H__
+
+#include <common.h>
+#include <memory/vaddr.h>
+
+#define IDCACHE_SIZE (1 << 14)
+
+// kinds of superinstructions, i.e. instruction pairs executed as one
+enum {
+  FUSE_NONE, FUSE_LUI_ADDI, FUSE_AUIPC_JALR, FUSE_AUIPC_LW,
+  FUSE_ADDI_BRANCH, FUSE_SLT_BRANCH, FUSE_SLTU_BRANCH,
+  NR_FUSE
+};
+
+// a decoded instruction, indexed by its pc in the decode cache,
+// or stored in a basic block by the block engine
+typedef struct IDCacheEntry {
+  vaddr_t pc;
+  uint32_t inst;
+  uint8_t ilen;
+  uint8_t rd, rs1, rs2;
+  word_t imm;
+  const void *exec; // body of the matched INSTPAT, NULL if the entry is empty
+  IFDEF(CONFIG_INST_COUNT, uint16_t pat); // id of the matched INSTPAT
+#ifdef CONFIG_INST_FUSION
+  uint8_t fuse;     // kind of the superinstruction starting here
+  struct { uint8_t rd, rs1, rs2, funct3; word_t imm; } next; // the second instruction
+#endif
+} IDCacheEntry;
+
+extern MACHINE_LOCAL IDCacheEntry idcache[IDCACHE_SIZE];
+extern MACHINE_LOCAL uint8_t idcache_code_page[];
+extern MACHINE_LOCAL uint64_t g_nr_fuse[NR_FUSE];
+
+static inline IDCacheEntry* idcache_lookup(vaddr_t pc) {
+  IDCacheEntry *e = &idcache[(pc >> 2) & (IDCACHE_SIZE - 1)];
+  if (e->pc != pc) {
+    e->pc = pc;
+    e->exec = NULL;
+  }
+  return e;
+}
+
+// is there any cached instruction inside the pmem page of `paddr'?
+static inline bool idcache_check_page(paddr_t paddr) {
+  return idcache_code_page[(paddr - CONFIG_MBASE) >> PAGE_SHIFT];
+}
+
+void idcache_fill(IDCacheEntry *e, uint32_t inst, int ilen,
+    int rd, int rs1, int rs2, word_t imm, const void *exec);
+void idcache_mark_code(vaddr_t pc);
+void idcache_flush();
+void idcache_statistic();
+
+#endif
@@ -0,0 +1,50 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __CPU_INST_COUNT_H__
+#define __CPU_INST_COUNT_H__
+
+#include <cpu/decode.h>
+
+#ifdef CONFIG_INST_COUNT
+
+// Count the executions of each INSTPAT, in a dense array indexed by the id
+// given to the pattern when its table is built.
+
+typedef struct {
+  const char *name;
+  uint64_t count;
+  uint64_t taken;  // for branches, the executions which are taken
+  int8_t class;    // see isa_inst_class(), set at the first execution
+  uint8_t width;   // bytes accessed by loads and stores
+} InstCount;
+
+extern InstCount g_inst_count[INSTPAT_MAX];
+
+int inst_count_register(const char *name);
+void inst_count_first(InstCount *c, Decode *s);
+void inst_count_set_output(const char *prefix);
+void inst_count_statistic();
+
+static inline void inst_count_step(Decode *s, vaddr_t dnpc) {
+  InstCount *c = &g_inst_count[s->pat];
+  if (unlikely(c->count == 0)) inst_count_first(c, s);
+  c->count ++;
+  c->taken += (c->class == INST_BRANCH && dnpc != s->snpc);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,46 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __CPU_IQUEUE_H__
+#define __CPU_IQUEUE_H__
+
+#include <common.h>
+
+#ifdef CONFIG_IQUEUE
+
+// The last executed instructions, only formatted by iqueue_dump().
+
+#define IQUEUE_SIZE CONFIG_IQUEUE_SIZE
+static_assert((IQUEUE_SIZE & (IQUEUE_SIZE - 1)) == 0, "IQUEUE_SIZE must be a power of 2");
+
+typedef struct {
+  vaddr_t pc;
+  uint32_t inst;
+} IQueueEntry;
+
+extern HART_LOCAL IQueueEntry iqueue[IQUEUE_SIZE];
+extern HART_LOCAL uint64_t iqueue_nr;
+
+static inline void iqueue_push(vaddr_t pc, uint32_t inst) {
+  IQueueEntry *e = &iqueue[iqueue_nr ++ & (IQUEUE_SIZE - 1)];
+  e->pc = pc;
+  e->inst = inst;
+}
+
+void iqueue_dump();
+
+#endif
+
+#endif
@@ -0,0 +1,39 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __CPU_JIT_H__
+#define __CPU_JIT_H__
+
+#include <common.h>
+
+typedef uint32_t (*jit_code_t)(); // return the number of guest instructions executed
+
+typedef struct JitBlock {
+  vaddr_t pc;
+  int nr_inst;     // 0 if the first instruction can not be translated
+  jit_code_t code;
+  struct JitBlock *next;
+} JitBlock;
+
+extern bool jit_need_flush;
+
+void init_jit();
+JitBlock* jit_lookup(vaddr_t pc);
+void jit_flush();
+void jit_release();
+void jit_statistic();
+
+#endif
@@ -0,0 +1,32 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __CPU_PROFILE_H__
+#define __CPU_PROFILE_H__
+
+#include <common.h>
+
+// Sample the pc of the guest every some instructions or on a host timer.
+// The samples are resolved to the functions in the ELF of the image, with
+// the call stack tracked by the calls and returns of the guest.
+
+struct Decode;
+extern bool profile_enabled;
+
+void init_profile(const char *img_file, const char *prefix, uint64_t interval, int hz);
+void profile_step(struct Decode *s, vaddr_t dnpc);
+void profile_finish();
+
+#endif
@@ -0,0 +1,42 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __DEVICE_EVENT_H__
+#define __DEVICE_EVENT_H__
+
+#include <common.h>
+#include <checkpoint.h>
+
+// Events are scheduled in guest time, which advances with the number of
+// executed guest instructions, so device timing is deterministic.
+
+typedef void (*event_handler_t) ();
+
+typedef struct Event {
+  const char *name;
+  uint64_t when;   // in guest instructions
+  uint64_t period; // in guest instructions, 0 for one-shot events
+  event_handler_t handler;
+  int idx;         // position in the heap, -1 if not scheduled
+} Event;
+
+Event* event_add(const char *name, uint64_t period_us, event_handler_t handler);
+void event_schedule(Event *e, uint64_t delay_us);
+void event_cancel(Event *e);
+void event_run();
+void event_checkpoint(Checkpoint *c);
+uint64_t guest_time();
+
+#endif
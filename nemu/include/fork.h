@@ -0,0 +1,42 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __FORK_H__
+#define __FORK_H__
+
+#include <common.h>
+
+// Run the guest to a fork point, then fork children which continue from
+// there. The children share the memory of the parent copy-on-write.
+// The same pool of children runs the intervals of sampled simulation,
+// each one from its checkpoint.
+typedef struct {
+  int nr_child;         // 0 means no fork
+  int nr_job;           // the number of children running at the same time
+  uint64_t at_inst;     // fork after this number of instructions
+  bool use_pc;          // or fork when the pc reaches `pc'
+  vaddr_t pc;
+  const char *input;    // file loaded by each child, "%d" is the index of the child
+  paddr_t input_addr;
+  const char *sample_dir; // the directory of the checkpoints of the intervals
+  uint64_t sample_inst;   // the number of instructions of each interval
+} ForkConfig;
+
+extern ForkConfig fork_config;
+
+void fork_run();
+void sample_run();
+
+#endif
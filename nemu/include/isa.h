@@ -29,18 +29,23 @@ extern unsigned char isa_logo[];
 void init_isa();
 
 // reg
-extern CPU_state cpu;
+extern HART_LOCAL CPU_state cpu;
 void isa_reg_display();
 word_t isa_reg_str2val(const char *name, bool *success);
 
 // exec
 struct Decode;
+void isa_init_decode();
 int isa_exec_once(struct Decode *s);
+int isa_inst_class(struct Decode *s);
+extern const char *isa_inst_class_name[];
+int isa_inst_mem_width(struct Decode *s);
 
 // memory
 enum { MMU_DIRECT, MMU_TRANSLATE, MMU_FAIL };
 enum { MEM_TYPE_IFETCH, MEM_TYPE_READ, MEM_TYPE_WRITE };
 enum { MEM_RET_OK, MEM_RET_FAIL, MEM_RET_CROSS_PAGE };
+#define MEM_RET_SUPERPAGE 0x10 // or'ed to MEM_RET_OK if the leaf is a superpage
 #ifndef isa_mmu_check
 int isa_mmu_check(vaddr_t vaddr, int len, int type);
 #endif
@@ -0,0 +1,50 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __LIBNEMU_H__
+#define __LIBNEMU_H__
+
+// C API of libnemu.a (CONFIG_TARGET_LIB). Each machine has its own CPU,
+// physical memory and state. A machine can be run by any host thread, but
+// by only one thread at a time, and different machines can be run by
+// different threads in parallel.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct Nemu Nemu;
+
+Nemu* nemu_create();
+void nemu_destroy(Nemu *m);
+
+// load a raw image to the reset vector, return false on error
+bool nemu_load(Nemu *m, const char *img_file);
+// copy between `buf' and the physical memory of the machine
+void nemu_memcpy(Nemu *m, uint64_t paddr, void *buf, size_t n, bool to_guest);
+// the output of the serial, stderr by default
+void nemu_set_serial(Nemu *m, FILE *fp);
+
+// run at most `n' instructions, return the number of instructions executed
+uint64_t nemu_run(Nemu *m, uint64_t n);
+// return true if the machine has stopped by a trap or an error, and store
+// the exit code in `code', which is -1 after an error
+bool nemu_halted(Nemu *m, int *code);
+// read a register by its name in the debugger, e.g. "$a0" or "$pc"
+uint64_t nemu_reg(Nemu *m, const char *name, bool *success);
+uint64_t nemu_nr_inst(Nemu *m);
+
+#endif
@@ -0,0 +1,54 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __MEMORY_ACCESS_H__
+#define __MEMORY_ACCESS_H__
+
+#include <isa.h>
+#include <memory/host.h>
+#include <memory/paddr.h>
+#include <memory/vaddr.h>
+#include <cpu/idcache.h>
+
+// vaddr_read8/16/32/64() and vaddr_write8/16/32/64(), called by the
+// instruction bodies with the width known at decode time. Accesses to
+// pmem without translation are inlined, the others go through
+// vaddr_read/write(). Writes to pages with cached code also take the
+// slow path, which flushes the decode cache.
+#define VADDR_ACCESS(bits) \
+  static inline word_t vaddr_read##bits(vaddr_t addr) { \
+    if (likely(isa_mmu_check(addr, bits / 8, MEM_TYPE_READ) == MMU_DIRECT && \
+          in_pmem_range(addr, bits / 8))) { \
+      return host_read##bits(guest_to_host(addr)); \
+    } \
+    return vaddr_read(addr, bits / 8); \
+  } \
+  static inline void vaddr_write##bits(vaddr_t addr, word_t data) { \
+    if (likely(isa_mmu_check(addr, bits / 8, MEM_TYPE_WRITE) == MMU_DIRECT && \
+          in_pmem_range(addr, bits / 8) && !MUXDEF(CONFIG_IDCACHE, idcache_check_page(addr), false))) { \
+      host_write##bits(guest_to_host(addr), data); \
+      return; \
+    } \
+    vaddr_write(addr, bits / 8, data); \
+  }
+
+VADDR_ACCESS(8)
+VADDR_ACCESS(16)
+VADDR_ACCESS(32)
+#ifdef CONFIG_ISA64
+VADDR_ACCESS(64)
+#endif
+
+#endif
@@ -0,0 +1,36 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __MEMORY_DIRTY_H__
+#define __MEMORY_DIRTY_H__
+
+#include <common.h>
+
+// Track the pages of pmem written by anyone, including the code generated
+// by the JIT engines, by write-protecting them and catching the first
+// write to each page.
+//
+// Only the stores of the host code are caught. The kernel does not raise
+// a fault when a system call writes into a protected page, but fails with
+// EFAULT, so pmem is never the buffer of a read() or fread() while it is
+// tracked: the checkpoints stop the tracking before they are loaded, and
+// the inputs of the forked children are copied through a buffer.
+
+bool dirty_track_start(); // all pages are clean after this
+void dirty_track_stop();
+bool dirty_tracking();
+bool dirty_page(size_t idx);
+
+#endif
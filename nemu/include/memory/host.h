@@ -18,22 +18,32 @@
 
 #include <common.h>
 
+// host_read8/16/32/64() and host_write8/16/32/64()
+#define HOST_ACCESS(bits) \
+  static inline uint##bits##_t host_read##bits(void *addr) { return *(uint##bits##_t *)addr; } \
+  static inline void host_write##bits(void *addr, uint##bits##_t data) { *(uint##bits##_t *)addr = data; }
+
+HOST_ACCESS(8)
+HOST_ACCESS(16)
+HOST_ACCESS(32)
+HOST_ACCESS(64)
+
 static inline word_t host_read(void *addr, int len) {
   switch (len) {
-    case 1: return *(uint8_t  *)addr;
-    case 2: return *(uint16_t *)addr;
-    case 4: return *(uint32_t *)addr;
-    IFDEF(CONFIG_ISA64, case 8: return *(uint64_t *)addr);
+    case 1: return host_read8(addr);
+    case 2: return host_read16(addr);
+    case 4: return host_read32(addr);
+    IFDEF(CONFIG_ISA64, case 8: return host_read64(addr));
     default: MUXDEF(CONFIG_RT_CHECK, assert(0), return 0);
   }
 }
 
 static inline void host_write(void *addr, int len, word_t data) {
   switch (len) {
-    case 1: *(uint8_t  *)addr = data; return;
-    case 2: *(uint16_t *)addr = data; return;
-    case 4: *(uint32_t *)addr = data; return;
-    IFDEF(CONFIG_ISA64, case 8: *(uint64_t *)addr = data; return);
+    case 1: host_write8(addr, data); return;
+    case 2: host_write16(addr, data); return;
+    case 4: host_write32(addr, data); return;
+    IFDEF(CONFIG_ISA64, case 8: host_write64(addr, data); return);
     IFDEF(CONFIG_RT_CHECK, default: assert(0));
   }
 }
@@ -21,16 +21,29 @@
 #define PMEM_LEFT  ((paddr_t)CONFIG_MBASE)
 #define PMEM_RIGHT ((paddr_t)CONFIG_MBASE + CONFIG_MSIZE - 1)
 #define RESET_VECTOR (PMEM_LEFT + CONFIG_PC_RESET_OFFSET)
+// the part of pmem reached by 32-bit addresses, which is checked by the translated code
+#define PMEM_SIZE32 MUXDEF(PMEM64, (0x100000000ul - CONFIG_MBASE), CONFIG_MSIZE)
+
+#if   defined(CONFIG_PMEM_MALLOC) || defined(CONFIG_PMEM_SPARSE)
+extern MACHINE_LOCAL uint8_t *pmem;
+#else // CONFIG_PMEM_GARRAY
+extern uint8_t pmem[];
+#endif
 
 /* convert the guest physical address in the guest program to host virtual address in NEMU */
-uint8_t* guest_to_host(paddr_t paddr);
+static inline uint8_t* guest_to_host(paddr_t paddr) { return pmem + (paddr - CONFIG_MBASE); }
 /* convert the host virtual address in NEMU to guest physical address in the guest program */
-paddr_t host_to_guest(uint8_t *haddr);
+static inline paddr_t host_to_guest(uint8_t *haddr) { return haddr - pmem + CONFIG_MBASE; }
 
 static inline bool in_pmem(paddr_t addr) {
   return addr - CONFIG_MBASE < CONFIG_MSIZE;
 }
 
+// whether [addr, addr + len) is inside pmem, with one unsigned compare
+static inline bool in_pmem_range(paddr_t addr, int len) {
+  return (paddr_t)(addr - CONFIG_MBASE) <= (paddr_t)(CONFIG_MSIZE - len);
+}
+
 word_t paddr_read(paddr_t addr, int len);
 void paddr_write(paddr_t addr, int len, word_t data);
 
@@ -0,0 +1,33 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __MEMORY_SPARSE_H__
+#define __MEMORY_SPARSE_H__
+
+#include <common.h>
+
+// pmem reserved by mmap(), whose pages are allocated when first touched.
+// With MEM_RANDOM, the untouched pages are inaccessible, and the first
+// access to each page fills it with the random value. The kernel can not
+// fault them in, so sparse_touch() must be called before reading a file
+// into pmem.
+
+uint8_t* sparse_init();
+bool sparse_touched(uint8_t *p);           // whether the page at `p' is touched
+void sparse_touch(uint8_t *p, size_t len); // touch the pages in [p, p + len)
+void sparse_fill_page(size_t idx);         // called on a fault in page `idx'
+void sparse_clear();                       // all pages read as zero after this
+
+#endif
@@ -22,6 +22,13 @@ word_t vaddr_ifetch(vaddr_t addr, int len);
 word_t vaddr_read(vaddr_t addr, int len);
 void vaddr_write(vaddr_t addr, int len, word_t data);
 
+#ifdef CONFIG_TLB
+// the physical address of `addr', which is accessed by `type'
+paddr_t vaddr_translate(vaddr_t addr, int type);
+void tlb_flush();
+void tlb_flush_page(vaddr_t vaddr);
+#endif
+
 #define PAGE_SHIFT        12
 #define PAGE_SIZE         (1ul << PAGE_SHIFT)
 #define PAGE_MASK         (PAGE_SIZE - 1)
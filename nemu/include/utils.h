@@ -28,7 +28,7 @@ typedef struct {
   uint32_t halt_ret;
 } NEMUState;
 
-extern NEMUState nemu_state;
+extern MACHINE_LOCAL NEMUState nemu_state;
 
 // ----------- timer -----------
 
@@ -56,6 +56,9 @@ uint64_t get_time();
 
 #define ANSI_FMT(str, fmt) fmt str ANSI_NONE // output str with format str
 
+// format of the counters in the statistics, with thousands separators
+#define NUMBERIC_FMT MUXDEF(CONFIG_TARGET_AM, "%", "%'") PRIu64
+
 #define log_write(...) IFDEF(CONFIG_TARGET_NATIVE_ELF, \
   do { \
     extern FILE* log_fp; \
@@ -13,6 +13,9 @@ BUILD_DIR = $(WORK_DIR)/build
 INC_PATH := $(WORK_DIR)/include $(INC_PATH)
 OBJ_DIR  = $(BUILD_DIR)/obj-$(NAME)$(SO)
 BINARY   = $(BUILD_DIR)/$(NAME)$(SO)
+ifeq ($(LIBRARY),1)
+BINARY   = $(BUILD_DIR)/lib$(NAME).a
+endif
 
 # Compilation flags
 ifeq ($(CC),clang)
@@ -50,8 +53,14 @@ $(OBJ_DIR)/%.o: %.cc
 app: $(BINARY)
 
 $(BINARY):: $(OBJS) $(ARCHIVES)
+ifeq ($(LIBRARY),1)
+	@echo + AR $@
+	@rm -f $@
+	@ar rcs $@ $(OBJS)
+else
 	@echo + LD $@
 	@$(LD) -o $@ $(OBJS) $(LDFLAGS) $(ARCHIVES) $(LIBS)
+endif
 
 clean:
 	-rm -rf $(BUILD_DIR)
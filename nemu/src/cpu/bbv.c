@@ -0,0 +1,105 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <cpu/bbv.h>
+
+#ifdef CONFIG_BBV
+
+#define NR_BUCKET 4096
+
+typedef struct BBVEntry {
+  vaddr_t pc;         // the first instruction of the block
+  uint32_t id;        // starts from 1, as SimPoint expects
+  uint64_t count;     // instructions executed in the current interval
+  struct BBVEntry *next;
+} BBVEntry;
+
+extern HART_LOCAL uint64_t g_nr_guest_inst;
+
+bool bbv_enabled = false;
+static FILE *bbv_fp = NULL;
+static BBVEntry *bucket[NR_BUCKET] = {};
+static uint32_t nr_block = 0;
+static uint64_t interval = 0;
+static uint64_t next_dump = 0;
+static uint64_t nr_interval = 0;
+static vaddr_t cur_pc = 0;    // the block being executed
+static uint64_t cur_count = 0;
+static bool in_block = false;
+
+static BBVEntry* bbv_lookup(vaddr_t pc) {
+  int h = (pc >> 2) & (NR_BUCKET - 1);
+  for (BBVEntry *e = bucket[h]; e != NULL; e = e->next) {
+    if (e->pc == pc) return e;
+  }
+  BBVEntry *e = malloc(sizeof(BBVEntry));
+  assert(e);
+  e->pc = pc;
+  e->id = ++ nr_block;
+  e->count = 0;
+  e->next = bucket[h];
+  bucket[h] = e;
+  return e;
+}
+
+static void bbv_dump() {
+  // the block being executed is counted in this interval up to now
+  if (cur_count > 0) { bbv_lookup(cur_pc)->count += cur_count; cur_count = 0; }
+  fputc('T', bbv_fp);
+  for (int i = 0; i < NR_BUCKET; i ++) {
+    for (BBVEntry *e = bucket[i]; e != NULL; e = e->next) {
+      if (e->count == 0) continue;
+      fprintf(bbv_fp, ":%u:%" PRIu64 " ", e->id, e->count);
+      e->count = 0;
+    }
+  }
+  fputc('\n', bbv_fp);
+  nr_interval ++;
+}
+
+void init_bbv(const char *file, uint64_t n) {
+  bbv_fp = fopen(file, "w");
+  Assert(bbv_fp, "Can not open '%s'", file);
+  interval = n;
+  next_dump = g_nr_guest_inst + n;
+  bbv_enabled = true;
+  Log("Basic-block vectors are written to %s every %" PRIu64 " instructions", file, n);
+}
+
+void bbv_step(vaddr_t pc, vaddr_t dnpc, vaddr_t snpc, int nr_inst) {
+  if (!in_block) { cur_pc = pc; in_block = true; }
+  cur_count += nr_inst;
+  if (dnpc != snpc) {
+    // a control transfer ends the block
+    bbv_lookup(cur_pc)->count += cur_count;
+    cur_count = 0;
+    in_block = false;
+  }
+  if (g_nr_guest_inst >= next_dump) {
+    bbv_dump();
+    next_dump += interval;
+  }
+}
+
+void bbv_finish() {
+  if (!bbv_enabled) return;
+  // the last interval may be shorter
+  if (g_nr_guest_inst + interval > next_dump) bbv_dump();
+  fclose(bbv_fp);
+  bbv_enabled = false;
+  Log("Basic-block vectors: intervals = %" PRIu64 ", blocks = %u", nr_interval, nr_block);
+}
+
+#endif
@@ -0,0 +1,99 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <cpu/block.h>
+
+#ifdef CONFIG_ENGINE_BLOCK
+
+#define NR_BUCKET 4096
+
+static Block *bucket[NR_BUCKET] = {};
+static uint64_t g_nr_block = 0;
+static uint64_t g_nr_chain = 0;
+static uint64_t g_nr_unchain = 0;
+bool block_need_flush = false;
+
+static inline int block_hash(vaddr_t pc) {
+  return (pc >> 2) & (NR_BUCKET - 1);
+}
+
+// return NULL if there is no block at `pc'
+Block* block_find(vaddr_t pc) {
+  for (Block *b = bucket[block_hash(pc)]; b != NULL; b = b->next) {
+    if (b->pc == pc) return b;
+  }
+  return NULL;
+}
+
+Block* block_lookup(vaddr_t pc) {
+  Block *b = block_find(pc);
+  if (b != NULL) return b;
+  int h = block_hash(pc);
+  b = malloc(sizeof(Block));
+  assert(b);
+  b->pc = pc;
+  b->nr_inst = 0;
+  b->done = false;
+  memset(b->succ, 0, sizeof(b->succ));
+  IFDEF(CONFIG_HOT_TRACE, b->count = 0; b->trace = NULL);
+  b->next = bucket[h];
+  bucket[h] = b;
+  g_nr_block ++;
+  return b;
+}
+
+// find the block at `pc' after leaving block `b', and remember it as a successor of `b'
+Block* block_next(Block *b, vaddr_t pc) {
+  for (int i = 0; i < ARRLEN(b->succ); i ++) {
+    if (b->succ[i].blk != NULL && b->succ[i].pc == pc) {
+      g_nr_chain ++;
+      return b->succ[i].blk;
+    }
+  }
+  g_nr_unchain ++;
+  Block *next = block_lookup(pc);
+  int i = (b->succ[0].blk == NULL ? 0 : 1);
+  b->succ[i].pc = pc;
+  b->succ[i].blk = next;
+  return next;
+}
+
+// The executing block may be modified by itself, so the blocks are only
+// marked here and released by block_release() after leaving the block.
+void block_flush() {
+  block_need_flush = true;
+}
+
+void block_release() {
+  for (int i = 0; i < NR_BUCKET; i ++) {
+    Block *b = bucket[i];
+    while (b != NULL) {
+      Block *next = b->next;
+      free(b);
+      b = next;
+    }
+    bucket[i] = NULL;
+  }
+  IFDEF(CONFIG_HOT_TRACE, hot_trace_release());
+  block_need_flush = false;
+}
+
+void block_statistic() {
+  Log("blocks translated = " NUMBERIC_FMT ", chained = " NUMBERIC_FMT ", unchained = " NUMBERIC_FMT,
+      g_nr_block, g_nr_chain, g_nr_unchain);
+}
+
+#endif
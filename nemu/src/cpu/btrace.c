@@ -0,0 +1,90 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <isa.h>
+#include <cpu/decode.h>
+#include <cpu/btrace.h>
+
+#ifdef CONFIG_BTRACE
+
+#define BUF_SIZE (4 * 1024 * 1024)
+#define NR_GPR ARRLEN(cpu.gpr)
+// the largest record, when every GPR is written
+#define MAX_RECORD (4 + 4 + 1 + NR_GPR * 5)
+
+bool btrace_enabled = false;
+static FILE *fp = NULL;
+static uint8_t *buf = NULL;
+static size_t used = 0;
+static uint64_t nr_record = 0, nr_byte = 0;
+IFDEF(CONFIG_BTRACE_REGS, static word_t last_gpr[ARRLEN(cpu.gpr)]);
+
+static void flush_buf() {
+  if (used == 0) return;
+  Assert(fwrite(buf, used, 1, fp) == 1, "Can not write the binary trace");
+  nr_byte += used;
+  used = 0;
+}
+
+static inline void put32(uint32_t val) {
+  memcpy(buf + used, &val, 4);
+  used += 4;
+}
+
+void init_btrace(const char *file) {
+  fp = fopen(file, "wb");
+  Assert(fp, "Can not open '%s'", file);
+  buf = malloc(BUF_SIZE);
+  assert(buf);
+  BTraceHeader h = { .version = BTRACE_VERSION, .flags = MUXDEF(CONFIG_BTRACE_REGS, BTRACE_REGS, 0),
+    .isa = str(__GUEST_ISA__) };
+  memcpy(h.magic, BTRACE_MAGIC, sizeof(h.magic));
+  memcpy(buf, &h, sizeof(h));
+  used = sizeof(h);
+#ifdef CONFIG_BTRACE_REGS
+  memcpy(last_gpr, cpu.gpr, sizeof(last_gpr));
+  for (int i = 0; i < NR_GPR; i ++) put32(last_gpr[i]);
+#endif
+  btrace_enabled = true;
+  Log("Binary instruction trace is written to %s", file);
+}
+
+void btrace_step(struct Decode *s) {
+  if (unlikely(used + MAX_RECORD > BUF_SIZE)) flush_buf();
+  put32(s->pc);
+  put32(s->isa.inst.val);
+#ifdef CONFIG_BTRACE_REGS
+  uint8_t *nr = buf + used ++;
+  *nr = 0;
+  for (int i = 1; i < NR_GPR; i ++) {
+    if (cpu.gpr[i] != last_gpr[i]) {
+      last_gpr[i] = cpu.gpr[i];
+      buf[used ++] = i;
+      put32(last_gpr[i]);
+      (*nr) ++;
+    }
+  }
+#endif
+  nr_record ++;
+}
+
+void btrace_finish() {
+  if (!btrace_enabled) return;
+  flush_buf();
+  fflush(fp);
+  Log("Binary instruction trace: records = %" PRIu64 ", bytes = %" PRIu64, nr_record, nr_byte);
+}
+
+#endif
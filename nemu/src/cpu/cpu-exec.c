@@ -16,6 +16,16 @@
 #include <cpu/cpu.h>
 #include <cpu/decode.h>
 #include <cpu/difftest.h>
+#include <cpu/idcache.h>
+#include <cpu/block.h>
+#include <cpu/jit.h>
+#include <cpu/aot.h>
+#include <cpu/smp.h>
+#include <cpu/bbv.h>
+#include <cpu/profile.h>
+#include <cpu/inst-count.h>
+#include <cpu/btrace.h>
+#include <cpu/iqueue.h>
 #include <locale.h>
 #include "../monitor/sdb/sdb.h"
 
@@ -26,32 +36,34 @@
  */
 #define MAX_INST_TO_PRINT 10
 
-CPU_state cpu = {};
-uint64_t g_nr_guest_inst = 0;
-static uint64_t g_timer = 0; // unit: us
-static bool g_print_step = false;
+HART_LOCAL CPU_state cpu = {};
+HART_LOCAL uint64_t g_nr_guest_inst = 0;
+static MACHINE_LOCAL uint64_t g_timer = 0; // unit: us
+static MACHINE_LOCAL bool g_print_step = false;
+#ifdef CONFIG_INST_MIX
+uint64_t g_inst_mix[NR_INST_CLASS] = {};
+#endif
 
 void device_update();
 
-static void trace_and_difftest(Decode *_this, vaddr_t dnpc) {
-#ifdef CONFIG_ITRACE_COND
-  if (ITRACE_COND) { log_write("%s\n", _this->logbuf); }
-#endif
-  if (g_print_step) { IFDEF(CONFIG_ITRACE, puts(_this->logbuf)); }
-  IFDEF(CONFIG_DIFFTEST, difftest_step(_this->pc, dnpc));
-#ifdef CONFIG_WATCHPOINT
-  bool ret = check_watchpoints();
-  if (ret == false)
-    Log_error("check_watchpoints failed!\n");
+// check the instruction budget inline to avoid the call in the common case
+static inline void device_poll() {
+  IFDEF(CONFIG_SMP, if (cpu.mhartid != 0) return); // only hart 0 polls devices
+  IFDEF(CONFIG_TARGET_LIB, return); // the devices of the library need no polling
+#if defined(CONFIG_DEVICE_POLL_BUDGET) || defined(CONFIG_DEVICE_EVENT)
+  extern uint64_t g_device_deadline;
+  if (likely(g_nr_guest_inst < g_device_deadline)) return;
 #endif
+  device_update();
 }
 
-static void exec_once(Decode *s, vaddr_t pc) {
-  s->pc = pc; // 0x8000000
-  s->snpc = pc; // 0x8000000
-  isa_exec_once(s); // snpc += 4, dnpc += 4
-  cpu.pc = s->dnpc; // 0x80000004
+// number of guest instructions executed by the last exec_once()
+#define NR_EXEC(s) (1 + MUXDEF(CONFIG_INST_FUSION, (s)->fuse, 0))
+
 #ifdef CONFIG_ITRACE
+// formatting and disassembling are slow, so they are only done for the
+// instructions which are printed
+static void itrace_format(Decode *s) {
   char *p = s->logbuf;
   p += snprintf(p, sizeof(s->logbuf), FMT_WORD ":", s->pc); // 0x80000000:
   int ilen = s->snpc - s->pc; // 0x80000004 - 0x8000000 = 4. Cuz s->pc not updated.
@@ -74,37 +86,219 @@ static void exec_once(Decode *s, vaddr_t pc) {
 #else
   p[0] = '\0'; // the upstream llvm does not support loongarch32r
 #endif
+}
+#endif
+
+static void trace_and_difftest(Decode *_this, vaddr_t dnpc) {
+#ifdef CONFIG_ITRACE
+  bool log_enable();
+  bool to_log = ITRACE_COND && log_enable();
+  if (to_log || g_print_step) itrace_format(_this);
+  if (to_log) { log_write("%s\n", _this->logbuf); }
+  if (g_print_step) { puts(_this->logbuf); }
+#endif
+  IFDEF(CONFIG_IQUEUE, iqueue_push(_this->pc, _this->isa.inst.val));
+  IFDEF(CONFIG_DIFFTEST, difftest_step(_this->pc, dnpc));
+  IFDEF(CONFIG_BTRACE, if (btrace_enabled) btrace_step(_this));
+  IFDEF(CONFIG_INST_MIX, g_inst_mix[isa_inst_class(_this)] ++);
+  IFDEF(CONFIG_INST_COUNT, inst_count_step(_this, dnpc));
+  IFDEF(CONFIG_PROFILE, if (profile_enabled) profile_step(_this, dnpc));
+  IFDEF(CONFIG_BBV, if (bbv_enabled) bbv_step(_this->pc, dnpc, _this->snpc, NR_EXEC(_this)));
+#ifdef CONFIG_WATCHPOINT
+  bool ret = check_watchpoints();
+  if (ret == false)
+    Log_error("check_watchpoints failed!\n");
 #endif
 }
 
+static void exec_once(Decode *s, vaddr_t pc) {
+  s->pc = pc; // 0x8000000
+  s->snpc = pc; // 0x8000000
+  isa_exec_once(s); // snpc += 4, dnpc += 4
+  cpu.pc = s->dnpc; // 0x80000004
+}
+
+#ifdef CONFIG_ENGINE_BLOCK
+// execute at most `n' instructions from the beginning of block `b',
+// return the number of instructions executed
+static uint64_t exec_block(Block *b, Decode *s, uint64_t n) {
+  vaddr_t pc = b->pc;
+  int i = 0;
+  uint64_t nr = 0;
+  while (nr < n) {
+#ifdef CONFIG_INST_FUSION
+    if (i < b->nr_inst && b->inst[i].pc != pc) {
+      // a fused pair was executed separately, decode the rest of the block again
+      b->nr_inst = i;
+      b->done = false;
+    }
+#endif
+    if (i == b->nr_inst) {
+      if (b->done) break;
+      // reach the end of the instructions decoded so far, extend the block
+      b->inst[i].pc = pc;
+      b->inst[i].exec = NULL;
+      b->nr_inst ++;
+    }
+    s->de = &b->inst[i];
+    IFDEF(CONFIG_INST_FUSION, s->fuse = (nr + 1 < n));
+    exec_once(s, pc);
+    g_nr_guest_inst += NR_EXEC(s);
+    nr += NR_EXEC(s);
+    i ++;
+    trace_and_difftest(s, cpu.pc);
+    if (cpu.pc != s->snpc) {
+      // a control transfer at the last instruction ends the block
+      if (i == b->nr_inst) b->done = true;
+      break;
+    }
+    if (i == BLOCK_MAX_INST) { b->done = true; break; }
+    if (unlikely(nemu_state.state != NEMU_RUNNING || block_need_flush)) break;
+    pc = s->snpc;
+  }
+  return nr;
+}
+
+#ifdef CONFIG_HOT_TRACE
+#define TRACE_SLICE 65536 // poll devices at least this often
+
+// run the compiled trace of block `b' if there is one, and count the
+// executions of `b' to find hot traces, return 0 if no trace is run
+static uint64_t exec_trace(Block *b, uint64_t n) {
+  if (b->trace == NULL && ++ b->count == CONFIG_HOT_TRACE_THRESHOLD) {
+    b->trace = hot_trace_compile(b->pc);
+  }
+  // a trace may exceed its budget by one block
+  if (b->trace == NULL || n <= BLOCK_MAX_INST) return 0;
+  uint64_t budget = n - BLOCK_MAX_INST;
+  uint64_t nr = b->trace(budget < TRACE_SLICE ? budget : TRACE_SLICE);
+  g_nr_guest_inst += nr;
+  return nr;
+}
+#endif
+
+static void execute(uint64_t n) {
+  Decode s;
+  Block *b = NULL;
+  while (n > 0) {
+    if (unlikely(block_need_flush)) { block_release(); b = NULL; }
+    b = (b == NULL ? block_lookup(cpu.pc) : block_next(b, cpu.pc));
+    uint64_t nr = MUXDEF(CONFIG_HOT_TRACE, exec_trace(b, n), 0);
+    if (nr > 0) b = NULL;
+    else nr = exec_block(b, &s, n);
+    n -= nr;
+    if (nemu_state.state != NEMU_RUNNING) break;
+    IFDEF(CONFIG_DEVICE, device_poll());
+  }
+}
+#elif defined(CONFIG_ENGINE_JIT)
+static void execute(uint64_t n) {
+  Decode s;
+  while (n > 0) {
+    if (unlikely(jit_need_flush)) jit_release();
+    JitBlock *b = jit_lookup(cpu.pc);
+    if (b->nr_inst > 0 && b->nr_inst <= n) {
+      uint32_t nr = b->code();
+      g_nr_guest_inst += nr;
+      n -= nr;
+    } else {
+      // the block can not be translated or it exceeds the budget, interpret one instruction
+      s.de = idcache_lookup(cpu.pc);
+      IFDEF(CONFIG_INST_FUSION, s.fuse = (n > 1));
+      exec_once(&s, cpu.pc);
+      g_nr_guest_inst += NR_EXEC(&s);
+      n -= NR_EXEC(&s);
+      trace_and_difftest(&s, cpu.pc);
+    }
+    if (nemu_state.state != NEMU_RUNNING) break;
+    IFDEF(CONFIG_DEVICE, device_poll());
+  }
+}
+#elif defined(CONFIG_ENGINE_AOT)
+#define AOT_SLICE 65536 // poll devices at least this often
+
+static void execute(uint64_t n) {
+  extern uint64_t g_nr_aot_call, g_nr_aot_inst;
+  Decode s;
+  while (n > 0) {
+    // a translated function may exceed its budget by AOT_CHECK_INTERVAL
+    aot_func_t f = (n > AOT_CHECK_INTERVAL ? aot_lookup(cpu.pc) : NULL);
+    uint64_t budget = n - AOT_CHECK_INTERVAL;
+    uint64_t nr = (f != NULL ? f(budget < AOT_SLICE ? budget : AOT_SLICE) : 0);
+    if (nr > 0) {
+      g_nr_guest_inst += nr;
+      n -= nr;
+      g_nr_aot_call ++;
+      g_nr_aot_inst += nr;
+    } else {
+      // not translated, or the translated function stops at once
+      s.de = idcache_lookup(cpu.pc);
+      IFDEF(CONFIG_INST_FUSION, s.fuse = (n > 1));
+      exec_once(&s, cpu.pc);
+      g_nr_guest_inst += NR_EXEC(&s);
+      n -= NR_EXEC(&s);
+      trace_and_difftest(&s, cpu.pc);
+    }
+    if (nemu_state.state != NEMU_RUNNING) break;
+    IFDEF(CONFIG_DEVICE, device_poll());
+  }
+}
+#else
 static void execute(uint64_t n) {
   Decode s;
-  for (;n > 0; n --) {
+  while (n > 0) {
+    IFDEF(CONFIG_IDCACHE, s.de = idcache_lookup(cpu.pc));
+    IFDEF(CONFIG_INST_FUSION, s.fuse = (n > 1));
     exec_once(&s, cpu.pc);
-    g_nr_guest_inst ++;
+    g_nr_guest_inst += NR_EXEC(&s);
+    n -= NR_EXEC(&s);
     trace_and_difftest(&s, cpu.pc);
     if (nemu_state.state != NEMU_RUNNING) break;
-    IFDEF(CONFIG_DEVICE, device_update());
+    IFDEF(CONFIG_DEVICE, device_poll());
   }
 }
+#endif
+
+#ifdef CONFIG_SMP
+// run the secondary hart of the calling thread
+void cpu_exec_hart(uint64_t n) {
+  execute(n);
+}
+#endif
 
 static void statistic() {
   IFNDEF(CONFIG_TARGET_AM, setlocale(LC_NUMERIC, ""));
-#define NUMBERIC_FMT MUXDEF(CONFIG_TARGET_AM, "%", "%'") PRIu64
   Log("host time spent = " NUMBERIC_FMT " us", g_timer);
   Log("total guest instructions = " NUMBERIC_FMT, g_nr_guest_inst);
   if (g_timer > 0) Log("simulation frequency = " NUMBERIC_FMT " inst/s", g_nr_guest_inst * 1000000 / g_timer);
   else Log("Finish running in less than 1 us and can not calculate the simulation frequency");
+  IFDEF(CONFIG_IDCACHE, idcache_statistic());
+  IFDEF(CONFIG_ENGINE_BLOCK, block_statistic());
+  IFDEF(CONFIG_HOT_TRACE, hot_trace_statistic());
+  IFDEF(CONFIG_ENGINE_JIT, jit_statistic());
+  IFDEF(CONFIG_ENGINE_AOT, aot_statistic());
+  IFDEF(CONFIG_SMP, smp_statistic());
+  IFDEF(CONFIG_BBV, bbv_finish());
+  IFDEF(CONFIG_PROFILE, profile_finish());
+  IFDEF(CONFIG_INST_COUNT, inst_count_statistic());
+  IFDEF(CONFIG_BTRACE, btrace_finish());
+#ifdef CONFIG_INST_MIX
+  for (int i = 0; i < NR_INST_CLASS; i ++) {
+    Log("instruction mix %-7s = " NUMBERIC_FMT " (%.2f%%)", isa_inst_class_name[i], g_inst_mix[i],
+        g_nr_guest_inst > 0 ? g_inst_mix[i] * 100.0 / g_nr_guest_inst : 0.0);
+  }
+#endif
 }
 
 void assert_fail_msg() {
+  IFDEF(CONFIG_IQUEUE, iqueue_dump());
   isa_reg_display();
   statistic();
 }
 
-/* Simulate how the CPU works. */
-void cpu_exec(uint64_t n) {
-  g_print_step = (n < MAX_INST_TO_PRINT);
+// run `n' instructions, or stop before executing the instruction at `*stop_pc'
+static void run(uint64_t n, const vaddr_t *stop_pc) {
+  g_print_step = (stop_pc == NULL && n < MAX_INST_TO_PRINT);
   switch (nemu_state.state) {
     case NEMU_END: case NEMU_ABORT:
       printf("Program execution has ended. To restart the program, exit NEMU and run again.\n");
@@ -114,11 +308,21 @@ void cpu_exec(uint64_t n) {
 
   uint64_t timer_start = get_time();
 
-  execute(n);
+  if (stop_pc == NULL) execute(n);
+  else {
+    // a budget of one instruction makes every engine stop at the exact pc
+    for (; n > 0 && cpu.pc != *stop_pc && nemu_state.state == NEMU_RUNNING; n --) execute(1);
+  }
 
   uint64_t timer_end = get_time();
   g_timer += timer_end - timer_start;
 
+#ifdef CONFIG_TARGET_LIB
+  // the state is reported to the caller of the library
+  if (nemu_state.state == NEMU_RUNNING) nemu_state.state = NEMU_STOP;
+  return;
+#endif
+
   switch (nemu_state.state) {
     case NEMU_RUNNING: nemu_state.state = NEMU_STOP; break;
 
@@ -128,7 +332,17 @@ void cpu_exec(uint64_t n) {
            (nemu_state.halt_ret == 0 ? ANSI_FMT("HIT GOOD TRAP", ANSI_FG_GREEN) :
             ANSI_FMT("HIT BAD TRAP", ANSI_FG_RED))),
           nemu_state.halt_pc);
+      IFDEF(CONFIG_IQUEUE, if (nemu_state.state == NEMU_END && nemu_state.halt_ret != 0) iqueue_dump());
       // fall through
     case NEMU_QUIT: statistic();
   }
 }
+
+/* Simulate how the CPU works. */
+void cpu_exec(uint64_t n) {
+  run(n, NULL);
+}
+
+void cpu_exec_until(vaddr_t pc, uint64_t n) {
+  run(n, &pc);
+}
@@ -0,0 +1,88 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <cpu/decode.h>
+#include <cpu/inst-count.h>
+
+// return the id of the pattern for the execution counters
+int instpat_add(InstPatTable *t, uint64_t key, uint64_t mask, uint64_t shift, const void *match, const char *name) {
+  Assert(t->nr_pat < INSTPAT_MAX, "too many patterns");
+  t->pat[t->nr_pat ++] = (InstPat) { .key = key << shift, .mask = mask << shift, .match = match, .name = name };
+  return MUXDEF(CONFIG_INST_COUNT, inst_count_register(name), 0);
+}
+
+static bool pat_in_bucket(InstPat *p, uint64_t sel, uint64_t val) {
+  return ((p->key ^ val) & p->mask & sel) == 0;
+}
+
+void instpat_build(InstPatTable *t, const void *end) {
+  // select the bits fixed in the most patterns to index the buckets
+  int count[64] = {};
+  for (int i = 0; i < t->nr_pat; i ++) {
+    for (int b = 0; b < 64; b ++) count[b] += (t->pat[i].mask >> b) & 1;
+  }
+  uint64_t sel = 0;
+  for (int k = 0; k < INSTPAT_BUCKET_BITS; k ++) {
+    int best = -1;
+    for (int b = 0; b < 64; b ++) {
+      if (!((sel >> b) & 1) && count[b] > 1 && (best == -1 || count[b] > count[best])) best = b;
+    }
+    if (best == -1) break;
+    sel |= 1ull << best;
+  }
+
+  // merge the selected bits into contiguous fields
+  int pos = 0;
+  t->nr_field = 0;
+  for (int b = 0; b < 64; b ++) {
+    if (!((sel >> b) & 1)) continue;
+    if (b > 0 && ((sel >> (b - 1)) & 1)) { t->field[t->nr_field - 1].len ++; }
+    else { t->field[t->nr_field ++] = (typeof(t->field[0])) { .lo = b, .len = 1, .pos = pos }; }
+    pos ++;
+  }
+
+  // fill each bucket with the candidates in the order of the table,
+  // stopping at the first pattern fully determined by the selected bits
+  int nr_bucket = 1 << pos;
+  t->bucket = malloc(sizeof(t->bucket[0]) * (nr_bucket + 1));
+  assert(t->bucket);
+  for (int pass = 0; pass < 2; pass ++) {
+    uint32_t n = 0;
+    for (int idx = 0; idx < nr_bucket; idx ++) {
+      uint64_t val = 0;
+      for (int i = 0; i < t->nr_field; i ++) {
+        val |= (uint64_t)BITS(idx, t->field[i].pos + t->field[i].len - 1, t->field[i].pos) << t->field[i].lo;
+      }
+      if (pass == 1) t->bucket[idx] = n;
+      for (int i = 0; i < t->nr_pat; i ++) {
+        InstPat *p = &t->pat[i];
+        if (!pat_in_bucket(p, sel, val)) continue;
+        if (pass == 1) t->list[n] = i;
+        n ++;
+        if ((p->mask & ~sel) == 0) break;
+      }
+    }
+    if (pass == 0) {
+      t->list = malloc(sizeof(t->list[0]) * n);
+      assert(t->list);
+    } else {
+      t->bucket[nr_bucket] = n;
+    }
+  }
+
+  t->end = end;
+  t->ready = true;
+}
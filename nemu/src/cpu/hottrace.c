@@ -0,0 +1,468 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+// The second tier of the block engine: once a block is hot, the blocks
+// reachable from it are lowered into one LLVM function over cpu.gpr and
+// pmem, optimized, and compiled by ORC LLJIT.
+
+#include <cpu/block.h>
+
+#ifdef CONFIG_HOT_TRACE
+
+#include <isa.h>
+#include <memory/paddr.h>
+#include <memory/vaddr.h>
+#include <llvm-c/Core.h>
+#include <llvm-c/Target.h>
+#include <llvm-c/LLJIT.h>
+#include <llvm-c/Transforms/PassManagerBuilder.h>
+
+#define MAX_TRACE_BLOCK 16
+
+typedef struct {
+  vaddr_t pc;
+  int nr_inst;
+  uint32_t inst[BLOCK_MAX_INST];
+  bool indirect;    // ends with jalr
+  LLVMBasicBlockRef bb;
+} TraceBlock;
+
+static TraceBlock tb[MAX_TRACE_BLOCK];
+static int nr_tb = 0;
+
+static LLVMOrcLLJITRef jit = NULL;
+static LLVMOrcThreadSafeContextRef tsctx = NULL;
+static int nr_trace = 0;
+static uint64_t g_nr_compile = 0;
+static uint64_t g_nr_fail = 0;
+
+// --- helpers called from the compiled code ---
+
+static word_t helper_div (word_t a, word_t b) { return (sword_t)a / (sword_t)b; }
+static word_t helper_divu(word_t a, word_t b) { return (sword_t)a / b; }
+static word_t helper_rem (word_t a, word_t b) { return (sword_t)a % (sword_t)b; }
+static word_t helper_remu(word_t a, word_t b) { return (sword_t)a % b; }
+
+// --- region formation ---
+
+// whether the instruction is supported, and whether it ends a trace block;
+// only the instructions accepted by the INSTPAT table are supported
+static bool supported(uint32_t i, bool *end) {
+  uint32_t opc = BITS(i, 6, 0), f3 = BITS(i, 14, 12), f7 = BITS(i, 31, 25);
+  *end = false;
+  switch (opc) {
+    case 0x37: case 0x17: return true;
+    case 0x6f: *end = true; return true;
+    case 0x67: *end = true; return f3 == 0;
+    case 0x63: *end = true; return f3 != 2 && f3 != 3;
+    case 0x03: return f3 != 3 && f3 <= 5;
+    case 0x23: return f3 <= 2;
+    case 0x13:
+      if (f3 == 1) return f7 == 0;
+      if (f3 == 5) return f7 == 0 || f7 == 0x20;
+      return true;
+    case 0x33: return f7 == 0 || f7 == 1 || (f7 == 0x20 && (f3 == 0 || f3 == 5));
+  }
+  return false;
+}
+
+static word_t imm_i(uint32_t i) { return SEXT(BITS(i, 31, 20), 12); }
+static word_t imm_s(uint32_t i) { return (SEXT(BITS(i, 31, 25), 7) << 5) | BITS(i, 11, 7); }
+static word_t imm_b(uint32_t i) {
+  return SEXT((BITS(i, 11, 8) << 1) | (BITS(i, 30, 25) << 5) | (BITS(i, 7, 7) << 11) | (BITS(i, 31, 31) << 12), 13);
+}
+static word_t imm_j(uint32_t i) {
+  return SEXT((BITS(i, 30, 21) << 1) | (BITS(i, 20, 20) << 11) | (BITS(i, 19, 12) << 12) | (BITS(i, 31, 31) << 20), 21);
+}
+
+static TraceBlock* find_tb(vaddr_t pc) {
+  for (int i = 0; i < nr_tb; i ++) if (tb[i].pc == pc) return &tb[i];
+  return NULL;
+}
+
+// scan the instructions from `pc' until a control transfer
+static bool scan(TraceBlock *t, vaddr_t pc) {
+  t->pc = pc;
+  t->nr_inst = 0;
+  t->indirect = false;
+  while (t->nr_inst < BLOCK_MAX_INST) {
+    if (!in_pmem(pc)) break;
+    uint32_t i = vaddr_ifetch(pc, 4);
+    bool end;
+    if (!supported(i, &end)) break;
+    idcache_mark_code(pc);
+    t->inst[t->nr_inst ++] = i;
+    pc += 4;
+    if (end) { t->indirect = (BITS(i, 6, 0) == 0x67); break; }
+  }
+  return t->nr_inst > 0;
+}
+
+static void add_tb(vaddr_t pc) {
+  if (nr_tb == MAX_TRACE_BLOCK || find_tb(pc) != NULL || block_find(pc) == NULL) return;
+  if (scan(&tb[nr_tb], pc)) nr_tb ++;
+}
+
+// the region contains the blocks already executed and reachable from `pc'
+static void form_region(vaddr_t pc) {
+  nr_tb = 0;
+  add_tb(pc);
+  for (int k = 0; k < nr_tb; k ++) {
+    TraceBlock *t = &tb[k];
+    uint32_t last = t->inst[t->nr_inst - 1];
+    vaddr_t last_pc = t->pc + (t->nr_inst - 1) * 4;
+    switch (BITS(last, 6, 0)) {
+      case 0x63: add_tb(last_pc + imm_b(last)); add_tb(last_pc + 4); break;
+      case 0x6f: add_tb(last_pc + imm_j(last)); break;
+      case 0x67: break;
+      default: add_tb(last_pc + 4); break;
+    }
+  }
+}
+
+// --- lowering to LLVM IR ---
+
+static LLVMContextRef ctx;
+static LLVMModuleRef mod;
+static LLVMBuilderRef bd;
+static LLVMValueRef fn;
+static LLVMTypeRef i8, i32, i64;
+static LLVMValueRef reg[32];   // allocas of the guest registers
+static LLVMValueRef cnt, exit_pc;
+static LLVMValueRef tb_cnt;     // instructions executed before the current block
+static LLVMBasicBlockRef exit_bb;
+
+static LLVMValueRef c32(uint32_t v) { return LLVMConstInt(i32, v, false); }
+static LLVMValueRef c64(uint64_t v) { return LLVMConstInt(i64, v, false); }
+
+static LLVMValueRef host_ptr(void *p, LLVMTypeRef ty) {
+  return LLVMConstIntToPtr(c64((uintptr_t)p), LLVMPointerType(ty, 0));
+}
+
+static LLVMValueRef get_reg(int r) {
+  return (r == 0 ? c32(0) : LLVMBuildLoad2(bd, i32, reg[r], ""));
+}
+
+static void set_reg(int r, LLVMValueRef v) {
+  if (r != 0) LLVMBuildStore(bd, v, reg[r]);
+}
+
+static LLVMBasicBlockRef new_bb() { return LLVMAppendBasicBlockInContext(ctx, fn, ""); }
+
+// count the first `nr_inst' instructions of the current block as executed
+static void add_cnt(int nr_inst) {
+  LLVMBuildStore(bd, LLVMBuildAdd(bd, tb_cnt, c64(nr_inst), ""), cnt);
+}
+
+static void goto_exit(LLVMValueRef pc, int nr_inst) {
+  add_cnt(nr_inst);
+  LLVMBuildStore(bd, pc, exit_pc);
+  LLVMBuildBr(bd, exit_bb);
+}
+
+// jump to the trace block at `pc', or leave the trace
+static void goto_pc(vaddr_t pc, int nr_inst) {
+  TraceBlock *t = find_tb(pc);
+  if (t == NULL) { goto_exit(c32(pc), nr_inst); return; }
+  add_cnt(nr_inst);
+  LLVMBuildBr(bd, t->bb);
+}
+
+static LLVMValueRef call_helper(void *f, int nr_arg, LLVMValueRef *arg, LLVMTypeRef ret) {
+  LLVMTypeRef param[] = { i32, i32, i32 };
+  LLVMTypeRef ty = LLVMFunctionType(ret, param, nr_arg, false);
+  return LLVMBuildCall2(bd, ty, host_ptr(f, ty), arg, nr_arg, "");
+}
+
+static LLVMValueRef in_pmem_cond(LLVMValueRef addr, int len, LLVMValueRef *off) {
+  *off = LLVMBuildSub(bd, addr, c32(CONFIG_MBASE), "");
+  return LLVMBuildICmp(bd, LLVMIntULE, *off, c32(PMEM_SIZE32 - len), "");
+}
+
+static LLVMValueRef pmem_ptr(LLVMValueRef off, LLVMTypeRef ty) {
+  LLVMValueRef idx = LLVMBuildZExt(bd, off, i64, "");
+  LLVMValueRef p = LLVMBuildGEP2(bd, i8, host_ptr(guest_to_host(CONFIG_MBASE), i8), &idx, 1, "");
+  return LLVMBuildBitCast(bd, p, LLVMPointerType(ty, 0), "");
+}
+
+static void set_cpu_pc(vaddr_t pc) {
+  LLVMBuildStore(bd, c32(pc), host_ptr(&cpu.pc, i32));
+}
+
+static LLVMValueRef lower_load(vaddr_t pc, LLVMValueRef addr, int f3) {
+  int len = 1 << (f3 & 3);
+  LLVMTypeRef ty = LLVMIntTypeInContext(ctx, len * 8);
+  LLVMValueRef off;
+  LLVMValueRef cond = in_pmem_cond(addr, len, &off);
+  LLVMBasicBlockRef fast = new_bb(), slow = new_bb(), done = new_bb();
+  LLVMBuildCondBr(bd, cond, fast, slow);
+
+  LLVMPositionBuilderAtEnd(bd, fast);
+  LLVMValueRef v = LLVMBuildLoad2(bd, ty, pmem_ptr(off, ty), "");
+  LLVMSetAlignment(v, 1);
+  LLVMBuildBr(bd, done);
+
+  LLVMPositionBuilderAtEnd(bd, slow);
+  set_cpu_pc(pc);
+  LLVMValueRef arg[] = { addr, c32(len) };
+  LLVMValueRef slow_v = call_helper(vaddr_read, 2, arg, i32);
+  if (len != 4) slow_v = LLVMBuildTrunc(bd, slow_v, ty, "");
+  LLVMBuildBr(bd, done);
+
+  LLVMPositionBuilderAtEnd(bd, done);
+  LLVMValueRef phi = LLVMBuildPhi(bd, ty, "");
+  LLVMValueRef val[] = { v, slow_v };
+  LLVMBasicBlockRef from[] = { fast, slow };
+  LLVMAddIncoming(phi, val, from, 2);
+  // lb and lh sign-extend, lbu and lhu zero-extend
+  if (len == 4) return phi;
+  return (f3 < 4 ? LLVMBuildSExt : LLVMBuildZExt)(bd, phi, i32, "");
+}
+
+static void lower_store(vaddr_t pc, LLVMValueRef addr, LLVMValueRef data, int f3, int nr_inst) {
+  int len = 1 << f3;
+  LLVMTypeRef ty = LLVMIntTypeInContext(ctx, len * 8);
+  LLVMValueRef off;
+  LLVMValueRef cond = in_pmem_cond(addr, len, &off);
+  LLVMBasicBlockRef check = new_bb(), fast = new_bb(), slow = new_bb(), done = new_bb(), leave = new_bb();
+  LLVMBuildCondBr(bd, cond, check, slow);
+
+  // pages with cached instructions go through the slow path to flush the caches
+  LLVMPositionBuilderAtEnd(bd, check);
+  LLVMValueRef page = LLVMBuildLShr(bd, off, c32(PAGE_SHIFT), "");
+  LLVMValueRef idx = LLVMBuildZExt(bd, page, i64, "");
+  LLVMValueRef code = LLVMBuildLoad2(bd, i8, LLVMBuildGEP2(bd, i8, host_ptr(idcache_code_page, i8), &idx, 1, ""), "");
+  LLVMBuildCondBr(bd, LLVMBuildICmp(bd, LLVMIntEQ, code, LLVMConstInt(i8, 0, false), ""), fast, slow);
+
+  LLVMPositionBuilderAtEnd(bd, fast);
+  LLVMValueRef st = LLVMBuildStore(bd, (len == 4 ? data : LLVMBuildTrunc(bd, data, ty, "")), pmem_ptr(off, ty));
+  LLVMSetAlignment(st, 1);
+  LLVMBuildBr(bd, done);
+
+  LLVMPositionBuilderAtEnd(bd, slow);
+  set_cpu_pc(pc);
+  LLVMValueRef arg[] = { addr, c32(len), data };
+  call_helper(vaddr_write, 3, arg, LLVMVoidTypeInContext(ctx));
+  LLVMValueRef flush = LLVMBuildLoad2(bd, i8, host_ptr(&block_need_flush, i8), "");
+  LLVMBuildCondBr(bd, LLVMBuildICmp(bd, LLVMIntNE, flush, LLVMConstInt(i8, 0, false), ""), leave, done);
+
+  // leave the trace if the store modifies code
+  LLVMPositionBuilderAtEnd(bd, leave);
+  goto_exit(c32(pc + 4), nr_inst);
+
+  LLVMPositionBuilderAtEnd(bd, done);
+}
+
+static LLVMValueRef lower_mulh(LLVMValueRef a, LLVMValueRef b, bool sa, bool sb) {
+  a = (sa ? LLVMBuildSExt : LLVMBuildZExt)(bd, a, i64, "");
+  b = (sb ? LLVMBuildSExt : LLVMBuildZExt)(bd, b, i64, "");
+  LLVMValueRef r = LLVMBuildLShr(bd, LLVMBuildMul(bd, a, b, ""), c64(32), "");
+  return LLVMBuildTrunc(bd, r, i32, "");
+}
+
+// `nr_inst' is the number of instructions of the block up to this one
+static void lower_inst(vaddr_t pc, uint32_t i, int nr_inst) {
+  int rd = BITS(i, 11, 7), rs1 = BITS(i, 19, 15), rs2 = BITS(i, 24, 20);
+  uint32_t opc = BITS(i, 6, 0), f3 = BITS(i, 14, 12), f7 = BITS(i, 31, 25);
+  LLVMValueRef a, b, r = NULL;
+
+  switch (opc) {
+    case 0x37: set_reg(rd, c32(BITS(i, 31, 12) << 12)); return;
+    case 0x17: set_reg(rd, c32(pc + (BITS(i, 31, 12) << 12))); return;
+    case 0x6f: set_reg(rd, c32(pc + 4)); goto_pc(pc + imm_j(i), nr_inst); return;
+    case 0x67:
+      a = LLVMBuildAnd(bd, LLVMBuildAdd(bd, get_reg(rs1), c32(imm_i(i)), ""), c32(~1u), "");
+      set_reg(rd, c32(pc + 4));
+      goto_exit(a, nr_inst);
+      return;
+    case 0x63: {
+      static const LLVMIntPredicate pred[] = { LLVMIntEQ, LLVMIntNE, 0, 0,
+        LLVMIntSLT, LLVMIntSGE, LLVMIntULT, LLVMIntUGE };
+      LLVMValueRef c = LLVMBuildICmp(bd, pred[f3], get_reg(rs1), get_reg(rs2), "");
+      LLVMBasicBlockRef taken = new_bb(), not_taken = new_bb();
+      LLVMBuildCondBr(bd, c, taken, not_taken);
+      LLVMPositionBuilderAtEnd(bd, taken);
+      goto_pc(pc + imm_b(i), nr_inst);
+      LLVMPositionBuilderAtEnd(bd, not_taken);
+      goto_pc(pc + 4, nr_inst);
+      return;
+    }
+    case 0x03:
+      set_reg(rd, lower_load(pc, LLVMBuildAdd(bd, get_reg(rs1), c32(imm_i(i)), ""), f3));
+      return;
+    case 0x23:
+      lower_store(pc, LLVMBuildAdd(bd, get_reg(rs1), c32(imm_s(i)), ""), get_reg(rs2), f3, nr_inst);
+      return;
+    case 0x13:
+      a = get_reg(rs1);
+      b = c32(imm_i(i));
+      switch (f3) {
+        case 0: r = LLVMBuildAdd(bd, a, b, ""); break;
+        case 2: r = LLVMBuildZExt(bd, LLVMBuildICmp(bd, LLVMIntSLT, a, b, ""), i32, ""); break;
+        case 3: r = LLVMBuildZExt(bd, LLVMBuildICmp(bd, LLVMIntULT, a, b, ""), i32, ""); break;
+        case 4: r = LLVMBuildXor(bd, a, b, ""); break;
+        case 6: r = LLVMBuildOr(bd, a, b, ""); break;
+        case 7: r = LLVMBuildAnd(bd, a, b, ""); break;
+        case 1: r = LLVMBuildShl(bd, a, c32(imm_i(i) & 0x1f), ""); break;
+        case 5: r = (f7 == 0 ? LLVMBuildLShr : LLVMBuildAShr)(bd, a, c32(imm_i(i) & 0x1f), ""); break;
+      }
+      set_reg(rd, r);
+      return;
+    case 0x33:
+      a = get_reg(rs1);
+      b = get_reg(rs2);
+      if (f7 == 1) {
+        static void *helper[] = { helper_div, helper_divu, helper_rem, helper_remu };
+        LLVMValueRef arg[] = { a, b };
+        switch (f3) {
+          case 0: r = LLVMBuildMul(bd, a, b, ""); break;
+          case 1: r = lower_mulh(a, b, true, true); break;
+          case 2: r = lower_mulh(a, b, true, false); break;
+          case 3: r = lower_mulh(a, b, false, false); break;
+          default: r = call_helper(helper[f3 - 4], 2, arg, i32); break;
+        }
+      } else {
+        LLVMValueRef sh = LLVMBuildAnd(bd, b, c32(0x1f), "");
+        switch (f3) {
+          case 0: r = (f7 == 0 ? LLVMBuildAdd : LLVMBuildSub)(bd, a, b, ""); break;
+          case 1: r = LLVMBuildShl(bd, a, sh, ""); break;
+          case 2: r = LLVMBuildZExt(bd, LLVMBuildICmp(bd, LLVMIntSLT, a, b, ""), i32, ""); break;
+          case 3: r = LLVMBuildZExt(bd, LLVMBuildICmp(bd, LLVMIntULT, a, b, ""), i32, ""); break;
+          case 4: r = LLVMBuildXor(bd, a, b, ""); break;
+          case 5: r = (f7 == 0 ? LLVMBuildLShr : LLVMBuildAShr)(bd, a, sh, ""); break;
+          case 6: r = LLVMBuildOr(bd, a, b, ""); break;
+          case 7: r = LLVMBuildAnd(bd, a, b, ""); break;
+        }
+      }
+      set_reg(rd, r);
+      return;
+  }
+  panic("unsupported instruction " FMT_WORD " in a hot trace", i);
+}
+
+static void lower_tb(TraceBlock *t, LLVMValueRef budget) {
+  LLVMPositionBuilderAtEnd(bd, t->bb);
+  // leave the trace when the budget is used up
+  LLVMBasicBlockRef body = new_bb(), leave = new_bb();
+  // each exit of the block counts the instructions executed before it
+  tb_cnt = LLVMBuildLoad2(bd, i64, cnt, "");
+  LLVMBuildCondBr(bd, LLVMBuildICmp(bd, LLVMIntUGE, tb_cnt, budget, ""), leave, body);
+  LLVMPositionBuilderAtEnd(bd, leave);
+  goto_exit(c32(t->pc), 0);
+
+  LLVMPositionBuilderAtEnd(bd, body);
+  vaddr_t pc = t->pc;
+  bool end = false;
+  for (int k = 0; k < t->nr_inst; k ++, pc += 4) {
+    lower_inst(pc, t->inst[k], k + 1);
+    supported(t->inst[k], &end);
+  }
+  if (!end) goto_pc(pc, t->nr_inst);
+}
+
+static void lower_region(const char *name) {
+  LLVMTypeRef param[] = { i64 };
+  fn = LLVMAddFunction(mod, name, LLVMFunctionType(i64, param, 1, false));
+  LLVMBasicBlockRef entry = new_bb();
+  exit_bb = new_bb();
+  for (int k = 0; k < nr_tb; k ++) tb[k].bb = new_bb();
+
+  // the guest registers live in allocas, which are promoted to SSA values
+  LLVMPositionBuilderAtEnd(bd, entry);
+  for (int r = 1; r < 32; r ++) {
+    reg[r] = LLVMBuildAlloca(bd, i32, "");
+    LLVMBuildStore(bd, LLVMBuildLoad2(bd, i32, host_ptr(&cpu.gpr[r], i32), ""), reg[r]);
+  }
+  cnt = LLVMBuildAlloca(bd, i64, "cnt");
+  exit_pc = LLVMBuildAlloca(bd, i32, "pc");
+  LLVMBuildStore(bd, c64(0), cnt);
+  LLVMBuildBr(bd, tb[0].bb);
+
+  for (int k = 0; k < nr_tb; k ++) lower_tb(&tb[k], LLVMGetParam(fn, 0));
+
+  // write back the registers and the pc
+  LLVMPositionBuilderAtEnd(bd, exit_bb);
+  for (int r = 1; r < 32; r ++) {
+    LLVMBuildStore(bd, LLVMBuildLoad2(bd, i32, reg[r], ""), host_ptr(&cpu.gpr[r], i32));
+  }
+  LLVMBuildStore(bd, LLVMBuildLoad2(bd, i32, exit_pc, ""), host_ptr(&cpu.pc, i32));
+  LLVMBuildRet(bd, LLVMBuildLoad2(bd, i64, cnt, ""));
+}
+
+static void optimize() {
+  LLVMPassManagerBuilderRef pmb = LLVMPassManagerBuilderCreate();
+  LLVMPassManagerBuilderSetOptLevel(pmb, 2);
+  LLVMPassManagerRef pm = LLVMCreatePassManager();
+  LLVMPassManagerBuilderPopulateModulePassManager(pmb, pm);
+  LLVMRunPassManager(pm, mod);
+  LLVMDisposePassManager(pm);
+  LLVMPassManagerBuilderDispose(pmb);
+}
+
+static bool check_error(LLVMErrorRef err) {
+  if (err == NULL) return true;
+  char *msg = LLVMGetErrorMessage(err);
+  Log("LLVM error: %s", msg);
+  LLVMDisposeErrorMessage(msg);
+  return false;
+}
+
+static void init_llvm() {
+  LLVMInitializeNativeTarget();
+  LLVMInitializeNativeAsmPrinter();
+  if (!check_error(LLVMOrcCreateLLJIT(&jit, NULL))) panic("can not create LLJIT");
+  if (tsctx == NULL) tsctx = LLVMOrcCreateNewThreadSafeContext();
+}
+
+hot_trace_t hot_trace_compile(vaddr_t pc) {
+  form_region(pc);
+  if (nr_tb == 0) return NULL;
+  if (jit == NULL) init_llvm();
+
+  char name[32];
+  snprintf(name, sizeof(name), "trace_%d", nr_trace ++);
+  ctx = LLVMOrcThreadSafeContextGetContext(tsctx);
+  i8 = LLVMInt8TypeInContext(ctx);
+  i32 = LLVMInt32TypeInContext(ctx);
+  i64 = LLVMInt64TypeInContext(ctx);
+  mod = LLVMModuleCreateWithNameInContext(name, ctx);
+  bd = LLVMCreateBuilderInContext(ctx);
+  lower_region(name);
+  LLVMDisposeBuilder(bd);
+  optimize();
+
+  g_nr_compile ++;
+  LLVMOrcThreadSafeModuleRef tsm = LLVMOrcCreateNewThreadSafeModule(mod, tsctx);
+  LLVMOrcJITTargetAddress addr = 0;
+  if (!check_error(LLVMOrcLLJITAddLLVMIRModule(jit, LLVMOrcLLJITGetMainJITDylib(jit), tsm)) ||
+      !check_error(LLVMOrcLLJITLookup(jit, &addr, name))) {
+    g_nr_fail ++;
+    return NULL;
+  }
+  return (hot_trace_t)(uintptr_t)addr;
+}
+
+// called with the blocks, all compiled traces are dropped
+void hot_trace_release() {
+  if (jit == NULL) return;
+  check_error(LLVMOrcDisposeLLJIT(jit));
+  jit = NULL;
+}
+
+void hot_trace_statistic() {
+  Log("hot traces compiled = " NUMBERIC_FMT ", failed = " NUMBERIC_FMT, g_nr_compile, g_nr_fail);
+}
+
+#endif
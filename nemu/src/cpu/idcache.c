@@ -0,0 +1,80 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <isa.h>
+#include <cpu/idcache.h>
+#include <cpu/block.h>
+#include <cpu/jit.h>
+#include <memory/paddr.h>
+
+#ifdef CONFIG_IDCACHE
+
+extern HART_LOCAL uint64_t g_nr_guest_inst;
+
+MACHINE_LOCAL IDCacheEntry idcache[IDCACHE_SIZE] = {};
+MACHINE_LOCAL uint8_t idcache_code_page[CONFIG_MSIZE >> PAGE_SHIFT] = {};
+static MACHINE_LOCAL uint64_t g_nr_fill = 0;
+static MACHINE_LOCAL uint64_t g_nr_flush = 0;
+MACHINE_LOCAL uint64_t g_nr_fuse[NR_FUSE] = {};
+
+void idcache_fill(IDCacheEntry *e, uint32_t inst, int ilen,
+    int rd, int rs1, int rs2, word_t imm, const void *exec) {
+  e->inst = inst;
+  e->ilen = ilen;
+  e->rd = rd;
+  e->rs1 = rs1;
+  e->rs2 = rs2;
+  e->imm = imm;
+  e->exec = exec;
+  IFDEF(CONFIG_INST_FUSION, e->fuse = FUSE_NONE);
+  idcache_mark_code(e->pc);
+  g_nr_fill ++;
+}
+
+void idcache_mark_code(vaddr_t pc) {
+  // without MMU, the pc is also the physical address of the instruction
+  paddr_t paddr = MUXDEF(CONFIG_TLB, vaddr_translate(pc, MEM_TYPE_IFETCH), pc);
+  if (in_pmem(paddr)) idcache_code_page[(paddr - CONFIG_MBASE) >> PAGE_SHIFT] = 1;
+}
+
+// called when the guest writes a page containing cached instructions
+void idcache_flush() {
+  for (int i = 0; i < IDCACHE_SIZE; i ++) {
+    idcache[i].exec = NULL;
+  }
+  memset(idcache_code_page, 0, sizeof(idcache_code_page));
+  IFDEF(CONFIG_ENGINE_BLOCK, block_flush());
+  IFDEF(CONFIG_ENGINE_JIT, jit_flush());
+  g_nr_flush ++;
+}
+
+void idcache_statistic() {
+  uint64_t hit = (g_nr_guest_inst > g_nr_fill ? g_nr_guest_inst - g_nr_fill : 0);
+  Log("decode cache hit = " NUMBERIC_FMT ", miss = " NUMBERIC_FMT ", flush = " NUMBERIC_FMT,
+      hit, g_nr_fill, g_nr_flush);
+  if (g_nr_guest_inst > 0) Log("decode cache hit rate = %.2f%%", hit * 100.0 / g_nr_guest_inst);
+#ifdef CONFIG_INST_FUSION
+  static const char *name[] = {
+    [FUSE_LUI_ADDI] = "lui+addi", [FUSE_AUIPC_JALR] = "auipc+jalr", [FUSE_AUIPC_LW] = "auipc+lw",
+    [FUSE_ADDI_BRANCH] = "addi+branch", [FUSE_SLT_BRANCH] = "slt+branch", [FUSE_SLTU_BRANCH] = "sltu+branch",
+  };
+  for (int i = FUSE_NONE + 1; i < NR_FUSE; i ++) {
+    Log("fused %-11s = " NUMBERIC_FMT, name[i], g_nr_fuse[i]);
+  }
+#endif
+}
+
+#endif
@@ -0,0 +1,137 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <isa.h>
+#include <cpu/inst-count.h>
+
+#ifdef CONFIG_INST_COUNT
+
+#define MAX_WIDTH 8
+
+InstCount g_inst_count[INSTPAT_MAX] = {};
+static int nr_pat = 0;
+static const char *out_prefix = NULL;
+
+int inst_count_register(const char *name) {
+  Assert(nr_pat < INSTPAT_MAX, "too many patterns to count");
+  g_inst_count[nr_pat].name = name;
+  return nr_pat ++;
+}
+
+void inst_count_first(InstCount *c, Decode *s) {
+  c->class = isa_inst_class(s);
+  c->width = (c->class == INST_LOAD || c->class == INST_STORE ? isa_inst_mem_width(s) : 0);
+}
+
+void inst_count_set_output(const char *prefix) {
+  out_prefix = prefix;
+}
+
+static int cmp_count(const void *a, const void *b) {
+  uint64_t x = g_inst_count[*(const int *)a].count, y = g_inst_count[*(const int *)b].count;
+  return (x < y) - (x > y);
+}
+
+static double percent(uint64_t n, uint64_t total) {
+  return total > 0 ? n * 100.0 / total : 0.0;
+}
+
+static FILE* open_output(const char *suffix) {
+  char file[256];
+  snprintf(file, sizeof(file), "%s.%s", out_prefix, suffix);
+  FILE *fp = fopen(file, "w");
+  Assert(fp, "Can not open '%s'", file);
+  return fp;
+}
+
+static void write_output(const int *order, int n, uint64_t total, uint64_t width[2][MAX_WIDTH + 1]) {
+  FILE *fp = open_output("csv");
+  fprintf(fp, "name,count,percent,class,width,taken,not_taken\n");
+  for (int i = 0; i < n; i ++) {
+    InstCount *c = &g_inst_count[order[i]];
+    fprintf(fp, "%s,%" PRIu64 ",%.4f,%s,%d,%" PRIu64 ",%" PRIu64 "\n", c->name, c->count,
+        percent(c->count, total), isa_inst_class_name[c->class], c->width,
+        c->taken, c->class == INST_BRANCH ? c->count - c->taken : 0);
+  }
+  fclose(fp);
+
+  fp = open_output("json");
+  fprintf(fp, "{\n  \"total\": %" PRIu64 ",\n  \"inst\": [", total);
+  for (int i = 0; i < n; i ++) {
+    InstCount *c = &g_inst_count[order[i]];
+    fprintf(fp, "%s\n    {\"name\": \"%s\", \"count\": %" PRIu64 ", \"class\": \"%s\"",
+        i == 0 ? "" : ",", c->name, c->count, isa_inst_class_name[c->class]);
+    if (c->width != 0) fprintf(fp, ", \"width\": %d", c->width);
+    if (c->class == INST_BRANCH) {
+      fprintf(fp, ", \"taken\": %" PRIu64 ", \"not_taken\": %" PRIu64, c->taken, c->count - c->taken);
+    }
+    fputc('}', fp);
+  }
+  fprintf(fp, "\n  ]");
+  const char *kind[2] = { "load_width", "store_width" };
+  for (int k = 0; k < 2; k ++) {
+    fprintf(fp, ",\n  \"%s\": {", kind[k]);
+    bool first = true;
+    for (int w = 1; w <= MAX_WIDTH; w *= 2) {
+      fprintf(fp, "%s\"%d\": %" PRIu64, first ? "" : ", ", w, width[k][w]);
+      first = false;
+    }
+    fputc('}', fp);
+  }
+  fprintf(fp, "\n}\n");
+  fclose(fp);
+  Log("Instruction counts are written to %s.csv and %s.json", out_prefix, out_prefix);
+}
+
+void inst_count_statistic() {
+  int order[INSTPAT_MAX];
+  int n = 0;
+  uint64_t total = 0, taken = 0, nr_branch = 0;
+  uint64_t width[2][MAX_WIDTH + 1] = {};
+  for (int i = 0; i < nr_pat; i ++) {
+    InstCount *c = &g_inst_count[i];
+    if (c->count == 0) continue;
+    order[n ++] = i;
+    total += c->count;
+    if (c->class == INST_BRANCH) { nr_branch += c->count; taken += c->taken; }
+    if (c->width != 0 && c->width <= MAX_WIDTH) width[c->class == INST_STORE][c->width] += c->count;
+  }
+  qsort(order, n, sizeof(order[0]), cmp_count);
+
+  for (int i = 0; i < n; i ++) {
+    InstCount *c = &g_inst_count[order[i]];
+    if (c->class == INST_BRANCH) {
+      Log("inst %-10s = " NUMBERIC_FMT " (%.2f%%), taken %.2f%%", c->name, c->count,
+          percent(c->count, total), percent(c->taken, c->count));
+    } else {
+      Log("inst %-10s = " NUMBERIC_FMT " (%.2f%%)", c->name, c->count, percent(c->count, total));
+    }
+  }
+  Log("branches taken = " NUMBERIC_FMT ", not taken = " NUMBERIC_FMT " (%.2f%% taken)",
+      taken, nr_branch - taken, percent(taken, nr_branch));
+  const char *kind[2] = { "load", "store" };
+  for (int k = 0; k < 2; k ++) {
+    uint64_t sum = 0;
+    for (int w = 1; w <= MAX_WIDTH; w *= 2) sum += width[k][w];
+    for (int w = 1; w <= MAX_WIDTH; w *= 2) {
+      if (width[k][w] == 0) continue;
+      Log("%-5s width %d = " NUMBERIC_FMT " (%.2f%%)", kind[k], w, width[k][w], percent(width[k][w], sum));
+    }
+  }
+
+  if (out_prefix != NULL) write_output(order, n, total, width);
+}
+
+#endif
@@ -0,0 +1,38 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <cpu/iqueue.h>
+
+#ifdef CONFIG_IQUEUE
+
+HART_LOCAL IQueueEntry iqueue[IQUEUE_SIZE] = {};
+HART_LOCAL uint64_t iqueue_nr = 0;
+
+void disassemble(char *str, int size, uint64_t pc, uint8_t *code, int nbyte);
+
+void iqueue_dump() {
+  uint64_t nr = (iqueue_nr < IQUEUE_SIZE ? iqueue_nr : IQUEUE_SIZE);
+  if (nr == 0) return;
+  printf("The last %" PRIu64 " instructions executed:\n", nr);
+  for (uint64_t i = iqueue_nr - nr; i < iqueue_nr; i ++) {
+    IQueueEntry *e = &iqueue[i & (IQUEUE_SIZE - 1)];
+    char buf[128];
+    disassemble(buf, sizeof(buf), e->pc, (uint8_t *)&e->inst, 4);
+    printf("%s " FMT_WORD ": %08x  %s\n", (i == iqueue_nr - 1 ? "-->" : "   "), e->pc, e->inst, buf);
+  }
+  fflush(stdout);
+}
+
+#endif
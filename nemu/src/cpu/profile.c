@@ -0,0 +1,255 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <isa.h>
+#include <cpu/decode.h>
+#include <cpu/profile.h>
+
+#ifdef CONFIG_PROFILE
+
+#include <elf.h>
+#include <signal.h>
+#include <sys/time.h>
+
+#define MAX_DEPTH 256
+#define NR_BUCKET 4096
+
+typedef struct {
+  vaddr_t addr, size;
+  char *name;
+  uint64_t count;   // samples whose pc is in this function
+} Symbol;
+
+// a call stack of symbol indices, as a line of the collapsed stacks
+typedef struct Stack {
+  int depth;
+  int *sym;
+  uint64_t count;
+  struct Stack *next;
+} Stack;
+
+bool profile_enabled = false;
+static const char *out_prefix = NULL;
+static uint64_t interval = 0, countdown = 0, nr_sample = 0;
+static volatile sig_atomic_t timer_fired = 0;
+static bool use_timer = false;
+
+static Symbol *sym = NULL;
+static int nr_sym = 0;
+static uint64_t nr_unknown = 0;
+static Stack *bucket[NR_BUCKET] = {};
+
+// the entries of the functions being called, the bottom one is where the profiling starts
+static vaddr_t stack[MAX_DEPTH];
+static int depth = 0;
+static int nr_hidden = 0; // calls deeper than MAX_DEPTH, which are not recorded
+static uint64_t nr_overflow = 0;
+
+static int cmp_addr(const void *a, const void *b) {
+  vaddr_t x = ((Symbol *)a)->addr, y = ((Symbol *)b)->addr;
+  return (x > y) - (x < y);
+}
+
+// only the function symbols of a 32-bit ELF are loaded
+static void load_elf(const char *file) {
+  FILE *fp = fopen(file, "rb");
+  if (fp == NULL) { Log("Can not open ELF '%s', the profile has addresses only", file); return; }
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  uint8_t *buf = malloc(size);
+  assert(buf);
+  int ret = fread(buf, size, 1, fp);
+  assert(ret == 1);
+  fclose(fp);
+
+  Elf32_Ehdr *eh = (void *)buf;
+  Assert(size >= sizeof(*eh) && memcmp(eh->e_ident, ELFMAG, SELFMAG) == 0 &&
+      eh->e_ident[EI_CLASS] == ELFCLASS32, "'%s' is not a 32-bit ELF", file);
+  Elf32_Shdr *sh = (void *)(buf + eh->e_shoff);
+  for (int i = 0; i < eh->e_shnum; i ++) {
+    if (sh[i].sh_type != SHT_SYMTAB) continue;
+    Elf32_Sym *st = (void *)(buf + sh[i].sh_offset);
+    char *strtab = (char *)buf + sh[sh[i].sh_link].sh_offset;
+    int n = sh[i].sh_size / sizeof(Elf32_Sym);
+    sym = realloc(sym, sizeof(Symbol) * (nr_sym + n));
+    assert(sym);
+    for (int j = 0; j < n; j ++) {
+      // global labels like _start in assembly have no type
+      int type = ELF32_ST_TYPE(st[j].st_info), bind = ELF32_ST_BIND(st[j].st_info);
+      bool label = (type == STT_NOTYPE && bind == STB_GLOBAL && st[j].st_shndx != SHN_UNDEF);
+      if (type != STT_FUNC && !label) continue;
+      sym[nr_sym ++] = (Symbol) { .addr = st[j].st_value, .size = st[j].st_size,
+        .name = strdup(strtab + st[j].st_name), .count = 0 };
+    }
+  }
+  free(buf);
+  qsort(sym, nr_sym, sizeof(Symbol), cmp_addr);
+  // functions written in assembly may have no size, they end at the next one
+  for (int i = 0; i < nr_sym; i ++) {
+    if (sym[i].size == 0) sym[i].size = (i + 1 < nr_sym ? sym[i + 1].addr : (vaddr_t)-1) - sym[i].addr;
+  }
+  Log("Profiling with %d functions from %s", nr_sym, file);
+}
+
+// return the index of the function containing `pc', or -1
+static int find_sym(vaddr_t pc) {
+  int l = 0, r = nr_sym - 1;
+  while (l <= r) {
+    int m = (l + r) / 2;
+    if (pc < sym[m].addr) r = m - 1;
+    else if (pc >= sym[m].addr + sym[m].size) l = m + 1;
+    else return m;
+  }
+  return -1;
+}
+
+static void timer_handler(int signum) {
+  timer_fired = 1;
+}
+
+void init_profile(const char *img_file, const char *prefix, uint64_t n, int hz) {
+  // the ELF is next to the image: foo.bin -> foo.elf
+  char elf[512];
+  const char *dot = (img_file != NULL ? strrchr(img_file, '.') : NULL);
+  if (img_file == NULL) elf[0] = '\0';
+  else if (dot != NULL && strcmp(dot, ".bin") == 0) snprintf(elf, sizeof(elf), "%.*s.elf", (int)(dot - img_file), img_file);
+  else snprintf(elf, sizeof(elf), "%s.elf", img_file);
+  if (elf[0] != '\0') load_elf(elf);
+
+  out_prefix = prefix;
+  interval = countdown = (n > 0 ? n : 1);
+  if (hz > 0) {
+    struct sigaction s;
+    memset(&s, 0, sizeof(s));
+    s.sa_handler = timer_handler;
+    int ret = sigaction(SIGPROF, &s, NULL);
+    Assert(ret == 0, "Can not set signal handler");
+    struct itimerval it = {};
+    it.it_value.tv_usec = 1000000 / hz;
+    it.it_interval = it.it_value;
+    ret = setitimer(ITIMER_PROF, &it, NULL);
+    Assert(ret == 0, "Can not set timer");
+    use_timer = true;
+  }
+  stack[0] = cpu.pc;
+  depth = 1;
+  profile_enabled = true;
+}
+
+static void record(vaddr_t pc) {
+  nr_sample ++;
+  int leaf = find_sym(pc);
+  if (leaf >= 0) sym[leaf].count ++;
+  else nr_unknown ++;
+
+  int frame[MAX_DEPTH + 1], n = 0;
+  for (int i = 0; i < depth; i ++) frame[n ++] = find_sym(stack[i]);
+  if (frame[n - 1] != leaf) frame[n ++] = leaf;
+  uint32_t h = 2166136261u;
+  for (int i = 0; i < n; i ++) h = (h ^ (uint32_t)frame[i]) * 16777619u;
+  Stack **p = &bucket[h & (NR_BUCKET - 1)];
+  for (; *p != NULL; p = &(*p)->next) {
+    if ((*p)->depth == n && memcmp((*p)->sym, frame, sizeof(int) * n) == 0) { (*p)->count ++; return; }
+  }
+  Stack *st = malloc(sizeof(Stack));
+  assert(st);
+  st->depth = n;
+  st->sym = malloc(sizeof(int) * n);
+  assert(st->sym);
+  memcpy(st->sym, frame, sizeof(int) * n);
+  st->count = 1;
+  st->next = NULL;
+  *p = st;
+}
+
+// follow the hints of the riscv ABI: a call links to ra or t0, a return
+// jumps to the link register
+static void push(vaddr_t entry) {
+  if (depth < MAX_DEPTH) stack[depth ++] = entry;
+  else { nr_hidden ++; nr_overflow ++; }
+}
+
+static void pop() {
+  if (nr_hidden > 0) nr_hidden --;
+  else if (depth > 1) depth --;
+}
+
+void profile_step(Decode *s, vaddr_t dnpc) {
+  uint32_t i = s->isa.inst.val;
+  int opcode = BITS(i, 6, 0), rd = BITS(i, 11, 7), rs1 = BITS(i, 19, 15);
+  bool rd_link = (rd == 1 || rd == 5), rs1_link = (rs1 == 1 || rs1 == 5);
+  if (opcode == 0x6f && rd_link) push(dnpc);
+  else if (opcode == 0x67) {
+    if (!rd_link && rs1_link) pop();
+    else if (rd_link) {
+      // a coroutine switch returns and calls at the same time
+      if (rs1_link && rs1 != rd) pop();
+      push(dnpc);
+    }
+  }
+
+  if (use_timer) {
+    if (!timer_fired) return;
+    timer_fired = 0;
+  } else if (-- countdown > 0) return;
+  else countdown = interval;
+  record(s->pc);
+}
+
+static const char* sym_name(int idx) {
+  return (idx >= 0 ? sym[idx].name : "[unknown]");
+}
+
+static int cmp_count(const void *a, const void *b) {
+  uint64_t x = ((Symbol *)a)->count, y = ((Symbol *)b)->count;
+  return (x < y) - (x > y);
+}
+
+void profile_finish() {
+  if (!profile_enabled) return;
+  profile_enabled = false;
+  if (use_timer) { struct itimerval it = {}; setitimer(ITIMER_PROF, &it, NULL); }
+
+  char file[512];
+  snprintf(file, sizeof(file), "%s.folded", out_prefix);
+  FILE *fp = fopen(file, "w");
+  Assert(fp, "Can not open '%s'", file);
+  for (int b = 0; b < NR_BUCKET; b ++) {
+    for (Stack *st = bucket[b]; st != NULL; st = st->next) {
+      for (int i = 0; i < st->depth; i ++) fprintf(fp, "%s%s", i ? ";" : "", sym_name(st->sym[i]));
+      fprintf(fp, " %" PRIu64 "\n", st->count);
+    }
+  }
+  fclose(fp);
+
+  // the stacks refer to the symbols by their indices, sort them at last
+  qsort(sym, nr_sym, sizeof(Symbol), cmp_count);
+  snprintf(file, sizeof(file), "%s.flat", out_prefix);
+  fp = fopen(file, "w");
+  Assert(fp, "Can not open '%s'", file);
+  fprintf(fp, "%10s %7s  %s\n", "samples", "%", "function");
+  for (int i = 0; i < nr_sym && sym[i].count > 0; i ++) {
+    fprintf(fp, "%10" PRIu64 " %6.2f%%  %s\n", sym[i].count, sym[i].count * 100.0 / nr_sample, sym[i].name);
+  }
+  if (nr_unknown > 0) {
+    fprintf(fp, "%10" PRIu64 " %6.2f%%  [unknown]\n", nr_unknown, nr_unknown * 100.0 / nr_sample);
+  }
+  fclose(fp);
+  Log("Profile: samples = %" PRIu64 ", written to %s.flat and %s.folded", nr_sample, out_prefix, out_prefix);
+  if (nr_overflow > 0) Log("Profile: %" PRIu64 " calls are deeper than %d and not tracked", nr_overflow, MAX_DEPTH);
+}
+
+#endif
@@ -0,0 +1,84 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <isa.h>
+#include <cpu/cpu.h>
+#include <cpu/smp.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#ifdef CONFIG_SMP
+
+#define HART_SLICE 4096 // check the state of NEMU at least this often
+
+typedef struct {
+  int id;
+  vaddr_t entry;
+  word_t sp;
+} HartBoot;
+
+extern HART_LOCAL uint64_t g_nr_guest_inst;
+void cpu_exec_hart(uint64_t n);
+
+static HartBoot boot[CONFIG_NR_HART] = {};
+static pthread_t thread[CONFIG_NR_HART];
+static uint64_t hart_nr_inst[CONFIG_NR_HART] = {};
+static bool started = false;
+static int nr_hart = 1; // started
+
+// Secondary harts follow the state of NEMU set by hart 0: they run while
+// NEMU is running, wait when it is stopped by the debugger, and exit when
+// the program ends.
+static void* hart_main(void *arg) {
+  HartBoot *b = arg;
+  cpu.pc = b->entry;
+  cpu.gpr[2] = b->sp;
+  cpu.mhartid = b->id;
+  while (true) {
+    int state = __atomic_load_n(&nemu_state.state, __ATOMIC_ACQUIRE);
+    if (state == NEMU_RUNNING) {
+      cpu_exec_hart(HART_SLICE);
+      __atomic_store_n(&hart_nr_inst[b->id], g_nr_guest_inst, __ATOMIC_RELAXED);
+    } else if (state == NEMU_STOP) {
+      usleep(1000);
+    } else {
+      break;
+    }
+  }
+  return NULL;
+}
+
+// start the harts 1 .. `n' - 1 at `entry', the stack of hart i is
+// [stack + i * stack_size, stack + (i + 1) * stack_size)
+void smp_start(int n, vaddr_t entry, word_t stack, word_t stack_size) {
+  if (started) return;
+  started = true;
+  nr_hart = n;
+  for (int i = 1; i < n; i ++) {
+    boot[i] = (HartBoot){ .id = i, .entry = entry, .sp = stack + (i + 1) * stack_size };
+    int ret = pthread_create(&thread[i], NULL, hart_main, &boot[i]);
+    Assert(ret == 0, "failed to create the thread of hart %d", i);
+  }
+  Log("start %d secondary harts at pc = " FMT_WORD, n - 1, entry);
+}
+
+void smp_statistic() {
+  for (int i = 1; i < nr_hart; i ++) {
+    Log("guest instructions of hart %d = " NUMBERIC_FMT, i,
+        __atomic_load_n(&hart_nr_inst[i], __ATOMIC_RELAXED));
+  }
+}
+
+#endif
@@ -16,7 +16,9 @@
 #include <common.h>
 #include <utils.h>
 #include <device/alarm.h>
-#ifndef CONFIG_TARGET_AM
+#include <device/event.h>
+#include <checkpoint.h>
+#ifdef CONFIG_TARGET_NATIVE_ELF
 #include <SDL2/SDL.h>
 #endif
 
@@ -28,22 +30,47 @@ void init_i8042();
 void init_audio();
 void init_disk();
 void init_sdcard();
+void init_mpe();
 void init_alarm();
 
 void send_key(uint8_t, bool);
 void vga_update_screen();
+void io_space_checkpoint(Checkpoint *c);
+void keyboard_checkpoint(Checkpoint *c);
+void sdcard_checkpoint(Checkpoint *c);
 
-void device_update() {
-  static uint64_t last = 0;
-  uint64_t now = get_time();
-  if (now - last < 1000000 / TIMER_HZ) {
-    return;
+uint64_t g_device_deadline = 0; // poll devices when g_nr_guest_inst reaches it
+
+#ifdef CONFIG_DEVICE_POLL_BUDGET
+#define POLL_PER_TICK 4
+#define BUDGET_MIN 1000
+#define BUDGET_MAX 100000000
+
+extern HART_LOCAL uint64_t g_nr_guest_inst;
+static uint64_t budget = BUDGET_MIN;
+
+// adapt the budget to the guest instructions executed since the last poll,
+// shrink at once to keep the latency of devices, but grow slowly
+static void update_budget(uint64_t now) {
+  static uint64_t last_time = 0, last_inst = 0;
+  uint64_t elapsed = now - last_time;
+  if (last_time != 0 && elapsed > 0) {
+    uint64_t target = (g_nr_guest_inst - last_inst) * (1000000 / TIMER_HZ / POLL_PER_TICK) / elapsed;
+    budget = (target < budget * 2 ? target : budget * 2);
+    if (budget < BUDGET_MIN) budget = BUDGET_MIN;
+    if (budget > BUDGET_MAX) budget = BUDGET_MAX;
   }
-  last = now;
+  last_time = now;
+  last_inst = g_nr_guest_inst;
+  g_device_deadline = g_nr_guest_inst + budget;
+}
+#endif
 
+// refresh the screen and handle the SDL events
+static void device_refresh() {
   IFDEF(CONFIG_HAS_VGA, vga_update_screen());
 
-#ifndef CONFIG_TARGET_AM
+#ifdef CONFIG_TARGET_NATIVE_ELF
   SDL_Event event;
   while (SDL_PollEvent(&event)) {
     switch (event.type) {
@@ -66,13 +93,39 @@ void device_update() {
 #endif
 }
 
+void device_update() {
+#ifdef CONFIG_DEVICE_EVENT
+  event_run();
+#else
+  static uint64_t last = 0;
+  uint64_t now = get_time();
+  IFDEF(CONFIG_DEVICE_POLL_BUDGET, update_budget(now));
+  if (now - last < 1000000 / TIMER_HZ) {
+    return;
+  }
+  last = now;
+  device_refresh();
+#endif
+}
+
 void sdl_clear_event_queue() {
-#ifndef CONFIG_TARGET_AM
+#ifdef CONFIG_TARGET_NATIVE_ELF
   SDL_Event event;
   while (SDL_PollEvent(&event));
 #endif
 }
 
+#ifndef CONFIG_TARGET_AM
+void device_checkpoint(Checkpoint *c) {
+  io_space_checkpoint(c);
+  IFDEF(CONFIG_HAS_KEYBOARD, keyboard_checkpoint(c));
+  IFDEF(CONFIG_HAS_SDCARD, sdcard_checkpoint(c));
+  // poll devices at once after restoring
+  if (!ckpt_saving(c)) g_device_deadline = 0;
+  IFDEF(CONFIG_DEVICE_EVENT, event_checkpoint(c));
+}
+#endif
+
 void init_device() {
   IFDEF(CONFIG_TARGET_AM, ioe_init());
   init_map();
@@ -84,6 +137,11 @@ void init_device() {
   IFDEF(CONFIG_HAS_AUDIO, init_audio());
   IFDEF(CONFIG_HAS_DISK, init_disk());
   IFDEF(CONFIG_HAS_SDCARD, init_sdcard());
+  IFDEF(CONFIG_HAS_MPE, init_mpe());
 
-  IFNDEF(CONFIG_TARGET_AM, init_alarm());
+#ifdef CONFIG_DEVICE_EVENT
+  event_add("refresh", 1000000 / TIMER_HZ, device_refresh);
+#else
+  IFDEF(CONFIG_TARGET_NATIVE_ELF, init_alarm());
+#endif
 }
@@ -0,0 +1,134 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <device/event.h>
+
+#define MAX_EVENT 16
+#define US2INST(us) ((us) * CONFIG_GUEST_MIPS)
+
+extern HART_LOCAL uint64_t g_nr_guest_inst;
+extern uint64_t g_device_deadline;
+
+static Event event_pool[MAX_EVENT] = {};
+static int nr_event = 0;
+
+// min-heap of the scheduled events, ordered by `when'
+static Event *heap[MAX_EVENT] = {};
+static int nr_heap = 0;
+
+static void heap_set(int i, Event *e) {
+  heap[i] = e;
+  e->idx = i;
+}
+
+static void sift_up(int i) {
+  Event *e = heap[i];
+  while (i > 0 && heap[(i - 1) / 2]->when > e->when) {
+    heap_set(i, heap[(i - 1) / 2]);
+    i = (i - 1) / 2;
+  }
+  heap_set(i, e);
+}
+
+static void sift_down(int i) {
+  Event *e = heap[i];
+  while (true) {
+    int c = i * 2 + 1;
+    if (c >= nr_heap) break;
+    if (c + 1 < nr_heap && heap[c + 1]->when < heap[c]->when) c ++;
+    if (heap[c]->when >= e->when) break;
+    heap_set(i, heap[c]);
+    i = c;
+  }
+  heap_set(i, e);
+}
+
+static void update_deadline() {
+  g_device_deadline = (nr_heap > 0 ? heap[0]->when : UINT64_MAX);
+}
+
+Event* event_add(const char *name, uint64_t period_us, event_handler_t handler) {
+  assert(nr_event < MAX_EVENT);
+  Event *e = &event_pool[nr_event ++];
+  e->name = name;
+  e->period = US2INST(period_us);
+  e->handler = handler;
+  e->idx = -1;
+  if (e->period != 0) event_schedule(e, period_us);
+  Log("Add event '%s' with period = %" PRIu64 " us", name, period_us);
+  return e;
+}
+
+void event_cancel(Event *e) {
+  if (e->idx == -1) return;
+  int i = e->idx;
+  e->idx = -1;
+  nr_heap --;
+  if (i != nr_heap) {
+    Event *last = heap[nr_heap];
+    heap_set(i, last);
+    sift_up(i);
+    sift_down(last->idx);
+  }
+  update_deadline();
+}
+
+void event_schedule(Event *e, uint64_t delay_us) {
+  event_cancel(e);
+  e->when = g_nr_guest_inst + US2INST(delay_us);
+  heap_set(nr_heap ++, e);
+  sift_up(nr_heap - 1);
+  update_deadline();
+}
+
+// run all events which are due
+void event_run() {
+  while (nr_heap > 0 && heap[0]->when <= g_nr_guest_inst) {
+    Event *e = heap[0];
+    if (e->period != 0) {
+      // keep the phase of periodic events even if they are handled late
+      e->when += e->period;
+      if (e->when <= g_nr_guest_inst) e->when = g_nr_guest_inst + e->period;
+      sift_down(0);
+    } else {
+      event_cancel(e);
+    }
+    e->handler();
+  }
+  update_deadline();
+}
+
+void event_checkpoint(Checkpoint *c) {
+  for (int i = 0; i < nr_event; i ++) {
+    Event *e = &event_pool[i];
+    bool scheduled = (e->idx != -1);
+    uint64_t when = e->when;
+    ckpt_data(c, &scheduled, sizeof(scheduled));
+    ckpt_data(c, &when, sizeof(when));
+    if (!ckpt_saving(c)) {
+      event_cancel(e);
+      e->when = when;
+      if (scheduled) {
+        heap_set(nr_heap ++, e);
+        sift_up(nr_heap - 1);
+      }
+    }
+  }
+  update_deadline();
+}
+
+uint64_t guest_time() {
+  return g_nr_guest_inst / CONFIG_GUEST_MIPS;
+}
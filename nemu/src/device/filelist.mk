@@ -15,6 +15,7 @@
 
 DIRS-y += src/device/io
 SRCS-$(CONFIG_DEVICE) += src/device/device.c src/device/alarm.c src/device/intr.c
+SRCS-$(CONFIG_DEVICE_EVENT) += src/device/event.c
 SRCS-$(CONFIG_HAS_SERIAL) += src/device/serial.c
 SRCS-$(CONFIG_HAS_TIMER) += src/device/timer.c
 SRCS-$(CONFIG_HAS_KEYBOARD) += src/device/keyboard.c
@@ -22,11 +23,14 @@ SRCS-$(CONFIG_HAS_VGA) += src/device/vga.c
 SRCS-$(CONFIG_HAS_AUDIO) += src/device/audio.c
 SRCS-$(CONFIG_HAS_DISK) += src/device/disk.c
 SRCS-$(CONFIG_HAS_SDCARD) += src/device/sdcard.c
+SRCS-$(CONFIG_HAS_MPE) += src/device/mpe.c
 
 SRCS-BLACKLIST-$(CONFIG_TARGET_AM) += src/device/alarm.c
+SRCS-BLACKLIST-$(CONFIG_TARGET_LIB) += src/device/alarm.c
+SRCS-BLACKLIST-$(CONFIG_DEVICE_EVENT) += src/device/alarm.c
 
 ifdef CONFIG_DEVICE
-ifndef CONFIG_TARGET_AM
+ifdef CONFIG_TARGET_NATIVE_ELF
 LIBS += -lSDL2
 endif
 endif
@@ -14,14 +14,16 @@
 ***************************************************************************************/
 
 #include <isa.h>
+#include <cpu/cpu.h>
 #include <memory/host.h>
 #include <memory/vaddr.h>
 #include <device/map.h>
+#include <checkpoint.h>
 
 #define IO_SPACE_MAX (2 * 1024 * 1024)
 
-static uint8_t *io_space = NULL;
-static uint8_t *p_space = NULL;
+static MACHINE_LOCAL uint8_t *io_space = NULL;
+static MACHINE_LOCAL uint8_t *p_space = NULL;
 
 uint8_t* new_space(int size) {
   uint8_t *p = p_space;
@@ -32,20 +34,37 @@ uint8_t* new_space(int size) {
   return p;
 }
 
-static void check_bound(IOMap *map, paddr_t addr) {
+static bool check_bound(IOMap *map, paddr_t addr) {
   if (map == NULL) {
+#ifdef CONFIG_TARGET_LIB
+    // only stop this machine, not the whole process
+    Log("address (" FMT_PADDR ") is out of bound at pc = " FMT_WORD, addr, cpu.pc);
+    set_nemu_state(NEMU_ABORT, cpu.pc, -1);
+    return false;
+#endif
     Assert(map != NULL, "address (" FMT_PADDR ") is out of bound at pc = " FMT_WORD, addr, cpu.pc);
   } else {
     Assert(addr <= map->high && addr >= map->low,
         "address (" FMT_PADDR ") is out of bound {%s} [" FMT_PADDR ", " FMT_PADDR "] at pc = " FMT_WORD,
         addr, map->name, map->low, map->high, cpu.pc);
   }
+  return true;
 }
 
 static void invoke_callback(io_callback_t c, paddr_t offset, int len, bool is_write) {
   if (c != NULL) { c(offset, len, is_write); }
 }
 
+#ifndef CONFIG_TARGET_AM
+// the registers and buffers of all devices
+void io_space_checkpoint(Checkpoint *c) {
+  uint64_t size = p_space - io_space, expect = size;
+  ckpt_data(c, &size, sizeof(size));
+  if (size != expect) { Log("the devices do not match the checkpoint"); size = 0; }
+  ckpt_pages(c, io_space, size);
+}
+#endif
+
 void init_map() {
   io_space = malloc(IO_SPACE_MAX);
   assert(io_space);
@@ -54,7 +73,7 @@ void init_map() {
 
 word_t map_read(paddr_t addr, int len, IOMap *map) {
   assert(len >= 1 && len <= 8);
-  check_bound(map, addr);
+  if (!check_bound(map, addr)) return 0;
   paddr_t offset = addr - map->low;
   invoke_callback(map->callback, offset, len, false); // prepare data to read
   word_t ret = host_read(map->space + offset, len);
@@ -63,7 +82,7 @@ word_t map_read(paddr_t addr, int len, IOMap *map) {
 
 void map_write(paddr_t addr, int len, word_t data, IOMap *map) {
   assert(len >= 1 && len <= 8);
-  check_bound(map, addr);
+  if (!check_bound(map, addr)) return;
   paddr_t offset = addr - map->low;
   host_write(map->space + offset, len, data);
   invoke_callback(map->callback, offset, len, true);
@@ -15,15 +15,80 @@
 
 #include <device/map.h>
 #include <memory/paddr.h>
+#include <memory/vaddr.h>
+#ifdef CONFIG_SMP
+#include <pthread.h>
+#endif
 
-#define NR_MAP 16
+// The maps are found by the physical page in a two-level table. A page
+// used by one map points to it, and a page shared by several maps (e.g.
+// the registers of small devices) has the index of the map of each byte.
+#define MMIO_DIR_SHIFT 22
+#define NR_MMIO_DIR (1 << (32 - MMIO_DIR_SHIFT))
+#define NR_MMIO_PAGE (1 << (MMIO_DIR_SHIFT - PAGE_SHIFT))
 
-static IOMap maps[NR_MAP] = {};
-static int nr_map = 0;
+typedef struct {
+  IOMap *map;       // the only map in this page
+  uint16_t *sub;    // otherwise, index + 1 of the map of each byte
+  uint8_t *host;    // the space of the map if it has no callback and covers the page
+} MMIOPage;
+
+static MACHINE_LOCAL MMIOPage *mmio_dir[NR_MMIO_DIR] = {};
+static MACHINE_LOCAL IOMap **maps = NULL;
+static MACHINE_LOCAL int nr_map = 0;
+
+static inline MMIOPage* mmio_page(paddr_t addr) {
+  if (MUXDEF(PMEM64, addr >> 32, 0)) return NULL;
+  MMIOPage *dir = mmio_dir[addr >> MMIO_DIR_SHIFT];
+  return (dir == NULL ? NULL : &dir[BITS(addr, MMIO_DIR_SHIFT - 1, PAGE_SHIFT)]);
+}
 
 static IOMap* fetch_mmio_map(paddr_t addr) {
-  int mapid = find_mapid_by_addr(maps, nr_map, addr);
-  return (mapid == -1 ? NULL : &maps[mapid]);
+  MMIOPage *p = mmio_page(addr);
+  if (p == NULL) return NULL;
+  IOMap *map = p->map;
+  if (map == NULL && p->sub != NULL) {
+    int id = p->sub[addr & PAGE_MASK];
+    map = (id == 0 ? NULL : maps[id - 1]);
+  }
+  if (map != NULL) difftest_skip_ref();
+  return map;
+}
+
+// the bytes of map `id' inside the page at `page'
+static void fill_sub(uint16_t *sub, paddr_t page, int id) {
+  IOMap *map = maps[id];
+  uint32_t l = (map->low > page ? map->low - page : 0);
+  uint32_t r = (map->high - page < PAGE_MASK ? map->high - page : PAGE_MASK);
+  for (uint32_t off = l; off <= r; off ++) sub[off] = id + 1;
+}
+
+static void add_page(paddr_t page, int id) {
+  MMIOPage **dir = &mmio_dir[page >> MMIO_DIR_SHIFT];
+  if (*dir == NULL) {
+    *dir = calloc(NR_MMIO_PAGE, sizeof(MMIOPage));
+    assert(*dir);
+  }
+  MMIOPage *p = mmio_page(page);
+  IOMap *map = maps[id];
+  if (p->map == NULL && p->sub == NULL) {
+    p->map = map;
+    if (map->callback == NULL && map->low <= page && map->high - page >= PAGE_MASK) {
+      p->host = (uint8_t *)map->space + (page - map->low);
+    }
+    return;
+  }
+  if (p->sub == NULL) {
+    // the page becomes shared
+    p->sub = calloc(PAGE_SIZE, sizeof(p->sub[0]));
+    assert(p->sub);
+    int old = 0;
+    while (maps[old] != p->map) old ++;
+    fill_sub(p->sub, page, old);
+    p->map = NULL;
+    p->host = NULL;
+  }
+  fill_sub(p->sub, page, id);
 }
 
 static void report_mmio_overlap(const char *name1, paddr_t l1, paddr_t r1,
@@ -34,30 +99,61 @@ static void report_mmio_overlap(const char *name1, paddr_t l1, paddr_t r1,
 
 /* device interface */
 void add_mmio_map(const char *name, paddr_t addr, void *space, uint32_t len, io_callback_t callback) {
-  assert(nr_map < NR_MAP);
   paddr_t left = addr, right = addr + len - 1;
+  Assert(MUXDEF(PMEM64, right >> 32 == 0, true), "MMIO region %s is above 4GiB", name);
+  Assert(nr_map < UINT16_MAX, "too many MMIO regions");
   if (in_pmem(left) || in_pmem(right)) {
     report_mmio_overlap(name, left, right, "pmem", PMEM_LEFT, PMEM_RIGHT);
   }
   for (int i = 0; i < nr_map; i++) {
-    if (left <= maps[i].high && right >= maps[i].low) {
-      report_mmio_overlap(name, left, right, maps[i].name, maps[i].low, maps[i].high);
+    if (left <= maps[i]->high && right >= maps[i]->low) {
+      report_mmio_overlap(name, left, right, maps[i]->name, maps[i]->low, maps[i]->high);
     }
   }
 
-  maps[nr_map] = (IOMap){ .name = name, .low = addr, .high = addr + len - 1,
-    .space = space, .callback = callback };
-  Log("Add mmio map '%s' at [" FMT_PADDR ", " FMT_PADDR "]",
-      maps[nr_map].name, maps[nr_map].low, maps[nr_map].high);
+  IOMap *map = malloc(sizeof(IOMap));
+  assert(map);
+  *map = (IOMap){ .name = name, .low = left, .high = right, .space = space, .callback = callback };
+  maps = realloc(maps, sizeof(maps[0]) * (nr_map + 1));
+  assert(maps);
+  maps[nr_map] = map;
+  for (paddr_t page = left & ~PAGE_MASK; page <= right; page += PAGE_SIZE) {
+    add_page(page, nr_map);
+    if ((paddr_t)(page + PAGE_SIZE) == 0) break; // the last page of the address space
+  }
+  Log("Add mmio map '%s' at [" FMT_PADDR ", " FMT_PADDR "]", map->name, map->low, map->high);
 
   nr_map ++;
 }
 
+#ifdef CONFIG_SMP
+// devices are not thread-safe, so the harts access them one at a time
+static pthread_mutex_t mmio_lock = PTHREAD_MUTEX_INITIALIZER;
+#define MMIO_LOCK()   pthread_mutex_lock(&mmio_lock)
+#define MMIO_UNLOCK() pthread_mutex_unlock(&mmio_lock)
+#else
+#define MMIO_LOCK()
+#define MMIO_UNLOCK()
+#endif
+
 /* bus interface */
+// The host address of `addr' if the access stays in a page of a device
+// region without a callback, which the bus can access as RAM.
+uint8_t* mmio_host(paddr_t addr, int len) {
+  MMIOPage *p = mmio_page(addr);
+  if (p == NULL || p->host == NULL || (addr & PAGE_MASK) + len > PAGE_SIZE) return NULL;
+  return p->host + (addr & PAGE_MASK);
+}
+
 word_t mmio_read(paddr_t addr, int len) {
-  return map_read(addr, len, fetch_mmio_map(addr));
+  MMIO_LOCK();
+  word_t ret = map_read(addr, len, fetch_mmio_map(addr));
+  MMIO_UNLOCK();
+  return ret;
 }
 
 void mmio_write(paddr_t addr, int len, word_t data) {
+  MMIO_LOCK();
   map_write(addr, len, data, fetch_mmio_map(addr));
+  MMIO_UNLOCK();
 }
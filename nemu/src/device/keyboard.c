@@ -14,6 +14,7 @@
 ***************************************************************************************/
 
 #include <device/map.h>
+#include <checkpoint.h>
 #include <utils.h>
 
 #define KEYDOWN_MASK 0x8000
@@ -64,6 +65,12 @@ static uint32_t key_dequeue() {
   return key;
 }
 
+void keyboard_checkpoint(Checkpoint *c) {
+  ckpt_data(c, key_queue, sizeof(key_queue));
+  ckpt_data(c, &key_f, sizeof(key_f));
+  ckpt_data(c, &key_r, sizeof(key_r));
+}
+
 void send_key(uint8_t scancode, bool is_keydown) {
   if (nemu_state.state == NEMU_RUNNING && keymap[scancode] != NEMU_KEY_NONE) {
     uint32_t am_scancode = keymap[scancode] | (is_keydown ? KEYDOWN_MASK : 0);
@@ -0,0 +1,52 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <device/map.h>
+#include <cpu/smp.h>
+
+// multiprocessor controller, writing the entry starts the secondary harts,
+// there is only one hart without SMP. Reading `nr_hart' gives the number
+// of harts, and writing it limits the number of harts to start, e.g. to
+// the stacks prepared by the guest.
+#define NR_HART MUXDEF(CONFIG_SMP, CONFIG_NR_HART, 1)
+
+enum { reg_nr_hart, reg_stack, reg_stack_size, reg_entry, nr_reg };
+
+static MACHINE_LOCAL uint32_t *mpe_base = NULL;
+static MACHINE_LOCAL uint32_t nr_start = NR_HART;
+
+static void mpe_io_handler(uint32_t offset, int len, bool is_write) {
+  assert(len == 4 && offset % 4 == 0);
+  switch (offset / 4) {
+    case reg_nr_hart:
+      if (is_write) {
+        uint32_t n = mpe_base[reg_nr_hart];
+        nr_start = (n < 1 ? 1 : (n < NR_HART ? n : NR_HART));
+      }
+      mpe_base[reg_nr_hart] = NR_HART;
+      break;
+    case reg_entry:
+#ifdef CONFIG_SMP
+      if (is_write) smp_start(nr_start, mpe_base[reg_entry], mpe_base[reg_stack], mpe_base[reg_stack_size]);
+#endif
+      break;
+  }
+}
+
+void init_mpe() {
+  mpe_base = (uint32_t *)new_space(sizeof(uint32_t) * nr_reg);
+  mpe_base[reg_nr_hart] = NR_HART;
+  add_mmio_map("mpe", CONFIG_MPE_CTL_MMIO, mpe_base, sizeof(uint32_t) * nr_reg, mpe_io_handler);
+}
@@ -14,6 +14,7 @@
 ***************************************************************************************/
 
 #include <device/map.h>
+#include <checkpoint.h>
 #include "mmc.h"
 
 // http://www.files.e-shop.co.il/pdastore/Tech-mmc-samsung/SEC%20MMC%20SPEC%20ver09.pdf
@@ -122,6 +123,17 @@ static void sdcard_io_handler(uint32_t offset, int len, bool is_write) {
   }
 }
 
+void sdcard_checkpoint(Checkpoint *c) {
+  ckpt_data(c, &blkcnt, sizeof(blkcnt));
+  ckpt_data(c, &blk_addr, sizeof(blk_addr));
+  ckpt_data(c, &addr, sizeof(addr));
+  ckpt_data(c, &write_cmd, sizeof(write_cmd));
+  ckpt_data(c, &read_ext_csd, sizeof(read_ext_csd));
+  long pos = (fp ? ftell(fp) : 0);
+  ckpt_data(c, &pos, sizeof(pos));
+  if (!ckpt_saving(c) && fp) fseek(fp, pos, SEEK_SET);
+}
+
 void init_sdcard() {
   base = (uint32_t *)new_space(0x80);
   add_mmio_map("sdhci", CONFIG_SDCARD_CTL_MMIO, base, 0x80, sdcard_io_handler);
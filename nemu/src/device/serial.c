@@ -21,11 +21,16 @@
 
 #define CH_OFFSET 0
 
-static uint8_t *serial_base = NULL;
+static MACHINE_LOCAL uint8_t *serial_base = NULL;
 
+#ifdef CONFIG_TARGET_LIB
+MACHINE_LOCAL FILE *serial_fp = NULL; // set by the machine run by this thread
+#else
+#define serial_fp stderr
+#endif
 
 static void serial_putc(char ch) {
-  MUXDEF(CONFIG_TARGET_AM, putch(ch), putc(ch, stderr));
+  MUXDEF(CONFIG_TARGET_AM, putch(ch), putc(ch, serial_fp));
 }
 
 static void serial_io_handler(uint32_t offset, int len, bool is_write) {
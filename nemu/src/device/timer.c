@@ -15,20 +15,21 @@
 
 #include <device/map.h>
 #include <device/alarm.h>
+#include <device/event.h>
 #include <utils.h>
 
-static uint32_t *rtc_port_base = NULL;
+static MACHINE_LOCAL uint32_t *rtc_port_base = NULL;
 
 static void rtc_io_handler(uint32_t offset, int len, bool is_write) {
   assert(offset == 0 || offset == 4);
   if (!is_write && offset == 4) {
-    uint64_t us = get_time();
+    uint64_t us = MUXDEF(CONFIG_DEVICE_EVENT, guest_time(), get_time());
     rtc_port_base[0] = (uint32_t)us;
     rtc_port_base[1] = us >> 32;
   }
 }
 
-#ifndef CONFIG_TARGET_AM
+#ifdef CONFIG_TARGET_NATIVE_ELF
 static void timer_intr() {
   if (nemu_state.state == NEMU_RUNNING) {
     extern void dev_raise_intr();
@@ -44,5 +45,9 @@ void init_timer() {
 #else
   add_mmio_map("rtc", CONFIG_RTC_MMIO, rtc_port_base, 8, rtc_io_handler);
 #endif
-  IFNDEF(CONFIG_TARGET_AM, add_alarm_handle(timer_intr));
+#ifdef CONFIG_DEVICE_EVENT
+  event_add("timer", 1000000 / TIMER_HZ, timer_intr);
+#else
+  IFDEF(CONFIG_TARGET_NATIVE_ELF, add_alarm_handle(timer_intr));
+#endif
 }
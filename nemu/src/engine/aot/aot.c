@@ -0,0 +1,72 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <cpu/aot.h>
+
+#define NR_CACHE 4096
+
+static bool *valid = NULL; // whether the function matches the loaded image
+static struct { vaddr_t pc; aot_func_t func; } cache[NR_CACHE] = {};
+static int nr_valid = 0;
+
+uint64_t g_nr_aot_call = 0;
+uint64_t g_nr_aot_inst = 0;
+
+static uint32_t hash(vaddr_t start, vaddr_t end) {
+  uint32_t h = 2166136261u;
+  for (vaddr_t pc = start; pc < end; pc += 4) {
+    h = (h ^ vaddr_ifetch(pc, 4)) * 16777619u;
+  }
+  return h;
+}
+
+// only use the functions whose code is the same as the loaded image
+void init_aot() {
+  valid = calloc(aot_nr_func, sizeof(bool));
+  assert(valid);
+  for (int i = 0; i < aot_nr_func; i ++) {
+    const AotFunc *f = &aot_func[i];
+    if (i > 0) Assert(f->start >= aot_func[i - 1].end, "AOT functions are not sorted");
+    valid[i] = in_pmem(f->start) && in_pmem(f->end - 1) && hash(f->start, f->end) == f->hash;
+    nr_valid += valid[i];
+  }
+  for (int i = 0; i < NR_CACHE; i ++) cache[i].pc = 1; // never matches an aligned pc
+  Log("AOT functions = %d, matching the image = %d", aot_nr_func, nr_valid);
+}
+
+static aot_func_t search(vaddr_t pc) {
+  int l = 0, r = aot_nr_func - 1;
+  while (l <= r) {
+    int m = (l + r) / 2;
+    if (pc < aot_func[m].start) r = m - 1;
+    else if (pc >= aot_func[m].end) l = m + 1;
+    else return (valid[m] ? aot_func[m].func : NULL);
+  }
+  return NULL;
+}
+
+aot_func_t aot_lookup(vaddr_t pc) {
+  int idx = (pc >> 2) & (NR_CACHE - 1);
+  if (cache[idx].pc != pc) {
+    cache[idx].pc = pc;
+    cache[idx].func = search(pc);
+  }
+  return cache[idx].func;
+}
+
+void aot_statistic() {
+  Log("AOT code entered = " NUMBERIC_FMT ", instructions executed = " NUMBERIC_FMT,
+      g_nr_aot_call, g_nr_aot_inst);
+}
@@ -15,3 +15,9 @@
 
 INC_PATH += $(NEMU_HOME)/src/engine/$(ENGINE)
 DIRS-y += src/engine/$(ENGINE)
+SRCS-BLACKLIST-$(CONFIG_TARGET_LIB) += src/engine/interpreter/init.c
+
+# the block engine, JIT and AOT share the host calls with the interpreter
+SRCS-$(CONFIG_ENGINE_BLOCK) += src/engine/interpreter/hostcall.c
+SRCS-$(CONFIG_ENGINE_JIT) += src/engine/interpreter/hostcall.c
+SRCS-$(CONFIG_ENGINE_AOT) += src/engine/interpreter/hostcall.c $(call remove_quote,$(CONFIG_AOT_SOURCE))
@@ -0,0 +1,429 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <isa.h>
+#include <cpu/jit.h>
+#include <cpu/idcache.h>
+#include <memory/paddr.h>
+#include <memory/vaddr.h>
+#include <sys/mman.h>
+#include <stddef.h>
+
+#ifndef __x86_64__
+#error "the JIT engine only supports x86-64 hosts"
+#endif
+
+#define CODE_CACHE_SIZE (32 * 1024 * 1024)
+#define CODE_MAX_BLOCK  (16 * 1024) // upper bound of the host code of one block
+#define JIT_MAX_INST    64
+#define NR_BLOCK        (64 * 1024)
+#define NR_BUCKET       (16 * 1024)
+
+static uint8_t *code_cache = NULL;
+static uint8_t *cp = NULL; // current position in the code cache
+static JitBlock pool[NR_BLOCK] = {};
+static int nr_pool = 0;
+static JitBlock *bucket[NR_BUCKET] = {};
+bool jit_need_flush = false;
+
+static uint64_t g_nr_block = 0;
+static uint64_t g_nr_release = 0;
+
+// --- x86-64 encoder ---
+
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+enum { CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7, CC_L = 0xc, CC_GE = 0xd };
+enum { ALU_ADD = 0, ALU_OR = 1, ALU_AND = 4, ALU_SUB = 5, ALU_XOR = 6, ALU_CMP = 7 };
+enum { SH_SHL = 4, SH_SHR = 5, SH_SAR = 7 };
+
+static void emit8(uint8_t b) { *cp ++ = b; }
+static void emit32(uint32_t v) { memcpy(cp, &v, 4); cp += 4; }
+static void emit64(uint64_t v) { memcpy(cp, &v, 8); cp += 8; }
+
+static void rex(int w, int r, int x, int b) {
+  uint8_t v = 0x40 | (w << 3) | ((r >> 3) << 2) | ((x >> 3) << 1) | (b >> 3);
+  if (v != 0x40) emit8(v);
+}
+
+static void modrm_rr(int reg, int rm) { emit8(0xc0 | ((reg & 7) << 3) | (rm & 7)); }
+
+// [base + disp], `base' can not be rsp or r12
+static void modrm_mem(int reg, int base, int32_t disp) {
+  if (disp >= -128 && disp < 128) { emit8(0x40 | ((reg & 7) << 3) | (base & 7)); emit8(disp); }
+  else { emit8(0x80 | ((reg & 7) << 3) | (base & 7)); emit32(disp); }
+}
+
+// `opc r/m32, r32'
+static void op_rr(uint8_t opc, int dst, int src) { rex(0, src, 0, dst); emit8(opc); modrm_rr(src, dst); }
+static void mov_rr(int dst, int src) { op_rr(0x89, dst, src); }
+static void mov_ri(int dst, uint32_t imm) { rex(0, 0, 0, dst); emit8(0xb8 + (dst & 7)); emit32(imm); }
+static void mov_ri64(int dst, uint64_t imm) { rex(1, 0, 0, dst); emit8(0xb8 + (dst & 7)); emit64(imm); }
+static void mov_rm(int dst, int base, int32_t disp) { rex(0, dst, 0, base); emit8(0x8b); modrm_mem(dst, base, disp); }
+static void mov_mr(int base, int32_t disp, int src) { rex(0, src, 0, base); emit8(0x89); modrm_mem(src, base, disp); }
+static void mov_mi(int base, int32_t disp, uint32_t imm) { rex(0, 0, 0, base); emit8(0xc7); modrm_mem(0, base, disp); emit32(imm); }
+static void alu_ri(int op, int dst, uint32_t imm) { rex(0, 0, 0, dst); emit8(0x81); modrm_rr(op, dst); emit32(imm); }
+static void shift_ri(int op, int dst, uint8_t imm) { rex(0, 0, 0, dst); emit8(0xc1); modrm_rr(op, dst); emit8(imm); }
+static void shift_rcl(int op, int dst) { rex(0, 0, 0, dst); emit8(0xd3); modrm_rr(op, dst); }
+static void imul_rr(int dst, int src) { rex(0, dst, 0, src); emit8(0x0f); emit8(0xaf); modrm_rr(dst, src); }
+static void imul_rr64(int dst, int src) { rex(1, dst, 0, src); emit8(0x0f); emit8(0xaf); modrm_rr(dst, src); }
+static void movsxd(int dst, int src) { rex(1, dst, 0, src); emit8(0x63); modrm_rr(dst, src); }
+static void shr64_ri(int dst, uint8_t imm) { rex(1, 0, 0, dst); emit8(0xc1); modrm_rr(SH_SHR, dst); emit8(imm); }
+static void push(int r) { rex(0, 0, 0, r); emit8(0x50 + (r & 7)); }
+static void pop(int r) { rex(0, 0, 0, r); emit8(0x58 + (r & 7)); }
+
+// eax = (eax `cc' ecx) ? 1 : 0
+static void setcc_eax(int cc) {
+  op_rr(0x39, RAX, RCX);
+  emit8(0x0f); emit8(0x90 + cc); emit8(0xc0);
+  emit8(0x0f); emit8(0xb6); emit8(0xc0);
+}
+
+static uint8_t* jcc(int cc) { emit8(0x0f); emit8(0x80 + cc); emit32(0); return cp - 4; }
+static uint8_t* jmp() { emit8(0xe9); emit32(0); return cp - 4; }
+static void patch(uint8_t *site, uint8_t *target) {
+  int32_t rel = target - (site + 4);
+  memcpy(site, &rel, 4);
+}
+
+static void call(void *fn) {
+  mov_ri64(RAX, (uintptr_t)fn);
+  emit8(0xff); emit8(0xd0);
+}
+
+// --- helpers called from the translated code ---
+
+static word_t helper_div (word_t a, word_t b) { return (sword_t)a / (sword_t)b; }
+static word_t helper_divu(word_t a, word_t b) { return (sword_t)a / b; }
+static word_t helper_rem (word_t a, word_t b) { return (sword_t)a % (sword_t)b; }
+static word_t helper_remu(word_t a, word_t b) { return (sword_t)a % b; }
+
+// --- translation ---
+
+#define OFF_GPR(i) ((int)offsetof(CPU_state, gpr[i]))
+#define OFF_PC     ((int)offsetof(CPU_state, pc))
+
+static const int host_reg[] = { RBP, R12, R13, R14 };
+static int map[32]; // host register of each guest register, or -1
+static bool dirty[32];
+
+typedef struct {
+  uint8_t *site;
+  vaddr_t target;
+  bool dynamic; // cpu.pc is already written
+  int nr_inst;
+} Exit;
+
+static Exit exits[JIT_MAX_INST * 2 + 2];
+static int nr_exit = 0;
+
+static void get_reg(int host, int g) {
+  if (g == 0) op_rr(0x31, host, host);
+  else if (map[g] != -1) mov_rr(host, map[g]);
+  else mov_rm(host, RBX, OFF_GPR(g));
+}
+
+static void set_reg(int g, int host) {
+  if (g == 0) return;
+  if (map[g] != -1) { mov_rr(map[g], host); dirty[g] = true; }
+  else mov_mr(RBX, OFF_GPR(g), host);
+}
+
+static void add_exit(uint8_t *site, vaddr_t target, bool dynamic, int nr_inst) {
+  exits[nr_exit ++] = (Exit) { .site = site, .target = target, .dynamic = dynamic, .nr_inst = nr_inst };
+}
+
+enum { K_UNSUPPORTED, K_ALU, K_LOAD, K_STORE, K_BRANCH, K_JUMP };
+
+// check whether `inst' can be translated, and whether it ends the block;
+// only the instructions accepted by the INSTPAT table are translated
+static int classify(uint32_t i) {
+  uint32_t opc = BITS(i, 6, 0), f3 = BITS(i, 14, 12), f7 = BITS(i, 31, 25);
+  switch (opc) {
+    case 0x37: case 0x17: return K_ALU;                  // lui, auipc
+    case 0x6f: return K_JUMP;                            // jal
+    case 0x67: return (f3 == 0 ? K_JUMP : K_UNSUPPORTED); // jalr
+    case 0x63: return (f3 == 2 || f3 == 3 ? K_UNSUPPORTED : K_BRANCH);
+    case 0x03: return (f3 != 3 && f3 <= 5 ? K_LOAD : K_UNSUPPORTED); // lb, lh, lw, lbu, lhu
+    case 0x23: return (f3 <= 2 ? K_STORE : K_UNSUPPORTED);
+    case 0x13:
+      if (f3 == 1) return (f7 == 0 ? K_ALU : K_UNSUPPORTED);
+      if (f3 == 5) return (f7 == 0 || f7 == 0x20 ? K_ALU : K_UNSUPPORTED);
+      return K_ALU;
+    case 0x33:
+      if (f7 == 0 || f7 == 1) return K_ALU;
+      if (f7 == 0x20 && (f3 == 0 || f3 == 5)) return K_ALU;
+      return K_UNSUPPORTED;
+  }
+  return K_UNSUPPORTED;
+}
+
+static word_t imm_i(uint32_t i) { return SEXT(BITS(i, 31, 20), 12); }
+static word_t imm_s(uint32_t i) { return (SEXT(BITS(i, 31, 25), 7) << 5) | BITS(i, 11, 7); }
+static word_t imm_b(uint32_t i) {
+  return SEXT((BITS(i, 11, 8) << 1) | (BITS(i, 30, 25) << 5) | (BITS(i, 7, 7) << 11) | (BITS(i, 31, 31) << 12), 13);
+}
+static word_t imm_j(uint32_t i) {
+  return SEXT((BITS(i, 30, 21) << 1) | (BITS(i, 20, 20) << 11) | (BITS(i, 19, 12) << 12) | (BITS(i, 31, 31) << 20), 21);
+}
+
+static void emit_alu(vaddr_t pc, uint32_t i) {
+  int rd = BITS(i, 11, 7), rs1 = BITS(i, 19, 15), rs2 = BITS(i, 24, 20);
+  uint32_t opc = BITS(i, 6, 0), f3 = BITS(i, 14, 12), f7 = BITS(i, 31, 25);
+  word_t imm = imm_i(i);
+
+  if (opc == 0x37) { mov_ri(RAX, BITS(i, 31, 12) << 12); set_reg(rd, RAX); return; }
+  if (opc == 0x17) { mov_ri(RAX, pc + (BITS(i, 31, 12) << 12)); set_reg(rd, RAX); return; }
+
+  get_reg(RAX, rs1);
+  if (opc == 0x13) {
+    switch (f3) {
+      case 0: alu_ri(ALU_ADD, RAX, imm); break;
+      case 2: mov_ri(RCX, imm); setcc_eax(CC_L); break;
+      case 3: mov_ri(RCX, imm); setcc_eax(CC_B); break;
+      case 4: alu_ri(ALU_XOR, RAX, imm); break;
+      case 6: alu_ri(ALU_OR, RAX, imm); break;
+      case 7: alu_ri(ALU_AND, RAX, imm); break;
+      case 1: shift_ri(SH_SHL, RAX, imm & 0x1f); break;
+      case 5: shift_ri(f7 == 0 ? SH_SHR : SH_SAR, RAX, imm & 0x1f); break;
+    }
+    set_reg(rd, RAX);
+    return;
+  }
+
+  get_reg(RCX, rs2);
+  if (f7 == 1) {
+    switch (f3) {
+      case 0: imul_rr(RAX, RCX); break;
+      case 1: movsxd(RAX, RAX); movsxd(RCX, RCX); imul_rr64(RAX, RCX); shr64_ri(RAX, 32); break;
+      case 2: movsxd(RAX, RAX); imul_rr64(RAX, RCX); shr64_ri(RAX, 32); break;
+      case 3: imul_rr64(RAX, RCX); shr64_ri(RAX, 32); break;
+      default: {
+        static void *helper[] = { helper_div, helper_divu, helper_rem, helper_remu };
+        mov_rr(RDI, RAX); mov_rr(RSI, RCX);
+        call(helper[f3 - 4]);
+        break;
+      }
+    }
+  } else {
+    switch (f3) {
+      case 0: op_rr(f7 == 0 ? 0x01 : 0x29, RAX, RCX); break;
+      case 1: shift_rcl(SH_SHL, RAX); break;
+      case 2: setcc_eax(CC_L); break;
+      case 3: setcc_eax(CC_B); break;
+      case 4: op_rr(0x31, RAX, RCX); break;
+      case 5: shift_rcl(f7 == 0 ? SH_SHR : SH_SAR, RAX); break;
+      case 6: op_rr(0x09, RAX, RCX); break;
+      case 7: op_rr(0x21, RAX, RCX); break;
+    }
+  }
+  set_reg(rd, RAX);
+}
+
+static void emit_load(vaddr_t pc, uint32_t i) {
+  int rd = BITS(i, 11, 7), rs1 = BITS(i, 19, 15), f3 = BITS(i, 14, 12);
+  int len = 1 << (f3 & 3);
+  get_reg(RAX, rs1);
+  alu_ri(ALU_ADD, RAX, imm_i(i));
+
+  // fast path: read pmem directly
+  mov_rr(RCX, RAX);
+  alu_ri(ALU_SUB, RCX, CONFIG_MBASE);
+  alu_ri(ALU_CMP, RCX, PMEM_SIZE32 - len);
+  uint8_t *slow = jcc(CC_A);
+  static const uint8_t opc[] = { 0xbe, 0xbf, 0x8b, 0, 0xb6, 0xb7 }; // movsx8/16, mov, movzx8/16
+  rex(0, RAX, RCX, R15);
+  if (f3 != 2) emit8(0x0f);
+  emit8(opc[f3]);
+  emit8(((RAX & 7) << 3) | 4); emit8(((RCX & 7) << 3) | (R15 & 7)); // [r15 + rcx]
+  uint8_t *done = jmp();
+
+  // slow path: go through the memory interface
+  patch(slow, cp);
+  mov_mi(RBX, OFF_PC, pc);
+  mov_rr(RDI, RAX);
+  mov_ri(RSI, len);
+  call(vaddr_read);
+  if (f3 == 0) { emit8(0x0f); emit8(0xbe); emit8(0xc0); } // movsx eax, al
+  if (f3 == 1) { emit8(0x0f); emit8(0xbf); emit8(0xc0); } // movsx eax, ax
+
+  patch(done, cp);
+  set_reg(rd, RAX);
+}
+
+static void emit_store(vaddr_t pc, uint32_t i, int nr_inst) {
+  int rs1 = BITS(i, 19, 15), rs2 = BITS(i, 24, 20), f3 = BITS(i, 14, 12);
+  get_reg(RDI, rs1);
+  alu_ri(ALU_ADD, RDI, imm_s(i));
+  mov_ri(RSI, 1 << f3);
+  get_reg(RDX, rs2);
+  mov_mi(RBX, OFF_PC, pc);
+  call(vaddr_write);
+  // leave the block if the store modifies translated code
+  mov_ri64(RAX, (uintptr_t)&jit_need_flush);
+  emit8(0x80); emit8(0x38); emit8(0x00); // cmp byte [rax], 0
+  add_exit(jcc(CC_NE), pc + 4, false, nr_inst);
+}
+
+static void emit_branch(vaddr_t pc, uint32_t i, int nr_inst) {
+  static const int cc[] = { CC_E, CC_NE, -1, -1, CC_L, CC_GE, CC_B, CC_AE };
+  get_reg(RAX, BITS(i, 19, 15));
+  get_reg(RCX, BITS(i, 24, 20));
+  op_rr(0x39, RAX, RCX);
+  add_exit(jcc(cc[BITS(i, 14, 12)]), pc + imm_b(i), false, nr_inst);
+  add_exit(jmp(), pc + 4, false, nr_inst);
+}
+
+static void emit_jump(vaddr_t pc, uint32_t i, int nr_inst) {
+  int rd = BITS(i, 11, 7);
+  if (BITS(i, 6, 0) == 0x6f) {
+    mov_ri(RAX, pc + 4);
+    set_reg(rd, RAX);
+    add_exit(jmp(), pc + imm_j(i), false, nr_inst);
+  } else {
+    get_reg(RAX, BITS(i, 19, 15));
+    alu_ri(ALU_ADD, RAX, imm_i(i));
+    alu_ri(ALU_AND, RAX, ~1u);
+    mov_mr(RBX, OFF_PC, RAX);
+    mov_ri(RAX, pc + 4);
+    set_reg(rd, RAX);
+    add_exit(jmp(), 0, true, nr_inst);
+  }
+}
+
+static void translate(JitBlock *b) {
+  uint32_t inst[JIT_MAX_INST];
+  int kind[JIT_MAX_INST];
+  int n = 0;
+
+  // scan the block
+  vaddr_t pc = b->pc;
+  while (n < JIT_MAX_INST) {
+    uint32_t i = vaddr_ifetch(pc, 4);
+    int k = classify(i);
+    if (k == K_UNSUPPORTED) break;
+    idcache_mark_code(pc);
+    inst[n] = i;
+    kind[n ++] = k;
+    pc += 4;
+    if (k == K_BRANCH || k == K_JUMP) break;
+  }
+  b->nr_inst = n;
+  if (n == 0) return;
+
+  // map the most used guest registers to host registers
+  int use[32] = {};
+  for (int j = 0; j < n; j ++) {
+    use[BITS(inst[j], 11, 7)] ++; use[BITS(inst[j], 19, 15)] ++; use[BITS(inst[j], 24, 20)] ++;
+  }
+  use[0] = 0;
+  for (int g = 0; g < 32; g ++) { map[g] = -1; dirty[g] = false; }
+  for (int h = 0; h < ARRLEN(host_reg); h ++) {
+    int best = 0;
+    for (int g = 1; g < 32; g ++) if (map[g] == -1 && use[g] > use[best]) best = g;
+    if (use[best] <= 1) break;
+    map[best] = host_reg[h];
+  }
+
+  b->code = (jit_code_t)cp;
+  push(RBX); push(RBP); push(R12); push(R13); push(R14); push(R15);
+  emit8(0x48); emit8(0x83); emit8(0xec); emit8(0x08); // sub rsp, 8
+  mov_ri64(RBX, (uintptr_t)&cpu);
+  mov_ri64(R15, (uintptr_t)guest_to_host(CONFIG_MBASE));
+  for (int g = 1; g < 32; g ++) if (map[g] != -1) mov_rm(map[g], RBX, OFF_GPR(g));
+
+  nr_exit = 0;
+  pc = b->pc;
+  for (int j = 0; j < n; j ++, pc += 4) {
+    switch (kind[j]) {
+      case K_ALU: emit_alu(pc, inst[j]); break;
+      case K_LOAD: emit_load(pc, inst[j]); break;
+      case K_STORE: emit_store(pc, inst[j], j + 1); break;
+      case K_BRANCH: emit_branch(pc, inst[j], j + 1); break;
+      case K_JUMP: emit_jump(pc, inst[j], j + 1); break;
+    }
+  }
+  if (kind[n - 1] != K_BRANCH && kind[n - 1] != K_JUMP) add_exit(jmp(), pc, false, n);
+
+  // exits: write back the guest registers and return to the engine
+  uint8_t *epilogue_site[ARRLEN(exits)];
+  for (int j = 0; j < nr_exit; j ++) {
+    patch(exits[j].site, cp);
+    for (int g = 1; g < 32; g ++) if (dirty[g]) mov_mr(RBX, OFF_GPR(g), map[g]);
+    if (!exits[j].dynamic) mov_mi(RBX, OFF_PC, exits[j].target);
+    mov_ri(RAX, exits[j].nr_inst);
+    epilogue_site[j] = jmp();
+  }
+  for (int j = 0; j < nr_exit; j ++) patch(epilogue_site[j], cp);
+  emit8(0x48); emit8(0x83); emit8(0xc4); emit8(0x08); // add rsp, 8
+  pop(R15); pop(R14); pop(R13); pop(R12); pop(RBP); pop(RBX);
+  emit8(0xc3);
+
+  assert(cp - (uint8_t *)b->code < CODE_MAX_BLOCK);
+  g_nr_block ++;
+}
+
+// --- code cache ---
+
+static inline int block_hash(vaddr_t pc) {
+  return (pc >> 2) & (NR_BUCKET - 1);
+}
+
+JitBlock* jit_lookup(vaddr_t pc) {
+  int h = block_hash(pc);
+  JitBlock *b;
+  for (b = bucket[h]; b != NULL; b = b->next) {
+    if (b->pc == pc) return b;
+  }
+
+  if (nr_pool == NR_BLOCK || code_cache + CODE_CACHE_SIZE - cp < CODE_MAX_BLOCK) {
+    // the code cache is full, start over
+    jit_flush();
+    jit_release();
+  }
+  b = &pool[nr_pool ++];
+  b->pc = pc;
+  b->code = NULL;
+  translate(b);
+  b->next = bucket[h];
+  bucket[h] = b;
+  return b;
+}
+
+// The executing block may be modified by itself, so the code cache is
+// only marked here and released by jit_release() after leaving the block.
+void jit_flush() {
+  jit_need_flush = true;
+}
+
+void jit_release() {
+  cp = code_cache;
+  nr_pool = 0;
+  memset(bucket, 0, sizeof(bucket));
+  jit_need_flush = false;
+  g_nr_release ++;
+}
+
+void init_jit() {
+  code_cache = mmap(NULL, CODE_CACHE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  Assert(code_cache != MAP_FAILED, "Can not allocate the code cache");
+  cp = code_cache;
+  Log("JIT code cache: %d MB", CODE_CACHE_SIZE / 1024 / 1024);
+}
+
+void jit_statistic() {
+  Log("JIT blocks translated = " NUMBERIC_FMT ", code cache released = " NUMBERIC_FMT,
+      g_nr_block, g_nr_release);
+}
@@ -17,8 +17,15 @@ SRCS-y += src/nemu-main.c
 DIRS-y += src/cpu src/monitor src/utils
 DIRS-$(CONFIG_MODE_SYSTEM) += src/memory
 DIRS-BLACKLIST-$(CONFIG_TARGET_AM) += src/monitor/sdb
+SRCS-BLACKLIST-$(CONFIG_TARGET_AM) += src/monitor/checkpoint.c src/monitor/fork.c src/memory/dirty.c
+
+# the library replaces the monitor and the debugger with the API in src/nemu-lib.c
+SRCS-$(CONFIG_TARGET_LIB) += src/nemu-lib.c
+SRCS-BLACKLIST-$(CONFIG_TARGET_LIB) += src/nemu-main.c src/monitor/monitor.c src/monitor/fork.c
+DIRS-BLACKLIST-$(CONFIG_TARGET_LIB) += src/monitor/sdb
 
 SHARE = $(if $(CONFIG_TARGET_SHARE),1,0)
+LIBRARY = $(if $(CONFIG_TARGET_LIB),1,0)
 LIBS += $(if $(CONFIG_TARGET_NATIVE_ELF),-lreadline -ldl -pie,)
 
 ifdef mainargs
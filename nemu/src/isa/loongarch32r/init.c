@@ -35,6 +35,9 @@ static void restart() {
 }
 
 void init_isa() {
+  /* Build the tables to decode instructions. */
+  isa_init_decode();
+
   /* Load built-in image. */
   memcpy(guest_to_host(RESET_VECTOR), img, sizeof(img));
 
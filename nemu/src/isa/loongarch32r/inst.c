@@ -17,10 +17,9 @@
 #include <cpu/cpu.h>
 #include <cpu/ifetch.h>
 #include <cpu/decode.h>
+#include <memory/access.h>
 
 #define R(i) gpr(i)
-#define Mr vaddr_read
-#define Mw vaddr_write
 
 enum {
   TYPE_2RI12, TYPE_1RI20,
@@ -54,8 +53,8 @@ static int decode_exec(Decode *s) {
 
   INSTPAT_START();
   INSTPAT("0001110 ????? ????? ????? ????? ?????" , pcaddu12i, 1RI20 , R(rd) = s->pc + imm);
-  INSTPAT("0010100010 ???????????? ????? ?????"   , ld.w     , 2RI12 , R(rd) = Mr(src1 + imm, 4));
-  INSTPAT("0010100110 ???????????? ????? ?????"   , st.w     , 2RI12 , Mw(src1 + imm, 4, R(rd)));
+  INSTPAT("0010100010 ???????????? ????? ?????"   , ld.w     , 2RI12 , R(rd) = vaddr_read32(src1 + imm));
+  INSTPAT("0010100110 ???????????? ????? ?????"   , st.w     , 2RI12 , vaddr_write32(src1 + imm, R(rd)));
 
   INSTPAT("0000 0000 0010 10100 ????? ????? ?????", break    , N     , NEMUTRAP(s->pc, R(4))); // R(4) is $a0
   INSTPAT("????????????????? ????? ????? ?????"   , inv      , N     , INV(s->pc));
@@ -66,6 +65,15 @@ static int decode_exec(Decode *s) {
   return 0;
 }
 
+// execute decode_exec() once to build its table of patterns
+void isa_init_decode() {
+  static bool ready = false;
+  if (ready) return;
+  ready = true;
+  Decode s = {};
+  decode_exec(&s);
+}
+
 int isa_exec_once(Decode *s) {
   s->isa.inst.val = inst_fetch(&s->snpc, 4);
   return decode_exec(s);
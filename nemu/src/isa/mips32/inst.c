@@ -17,10 +17,9 @@
 #include <cpu/cpu.h>
 #include <cpu/ifetch.h>
 #include <cpu/decode.h>
+#include <memory/access.h>
 
 #define R(i) gpr(i)
-#define Mr vaddr_read
-#define Mw vaddr_write
 
 enum {
   TYPE_I, TYPE_U,
@@ -56,8 +55,8 @@ static int decode_exec(Decode *s) {
 
   INSTPAT_START();
   INSTPAT("001111 ????? ????? ????? ????? ??????", lui    , U, R(rd) = imm << 16);
-  INSTPAT("100011 ????? ????? ????? ????? ??????", lw     , I, R(rd) = Mr(src1 + imm, 4));
-  INSTPAT("101011 ????? ????? ????? ????? ??????", sw     , I, Mw(src1 + imm, 4, R(rd)));
+  INSTPAT("100011 ????? ????? ????? ????? ??????", lw     , I, R(rd) = vaddr_read32(src1 + imm));
+  INSTPAT("101011 ????? ????? ????? ????? ??????", sw     , I, vaddr_write32(src1 + imm, R(rd)));
 
   INSTPAT("011100 ????? ????? ????? ????? 111111", sdbbp  , N, NEMUTRAP(s->pc, R(2))); // R(2) is $v0;
   INSTPAT("?????? ????? ????? ????? ????? ??????", inv    , N, INV(s->pc));
@@ -68,6 +67,15 @@ static int decode_exec(Decode *s) {
   return 0;
 }
 
+// execute decode_exec() once to build its table of patterns
+void isa_init_decode() {
+  static bool ready = false;
+  if (ready) return;
+  ready = true;
+  Decode s = {};
+  decode_exec(&s);
+}
+
 int isa_exec_once(Decode *s) {
   s->isa.inst.val = inst_fetch(&s->snpc, 4);
   return decode_exec(s);
@@ -21,6 +21,8 @@
 typedef struct {
   word_t gpr[MUXDEF(CONFIG_RVE, 16, 32)];
   vaddr_t pc;
+  word_t mhartid;
+  IFDEF(CONFIG_RV_SV32, word_t satp);
 } MUXDEF(CONFIG_RV64, riscv64_CPU_state, riscv32_CPU_state);
 
 // decode
@@ -30,6 +32,16 @@ typedef struct {
   } inst;
 } MUXDEF(CONFIG_RV64, riscv64_ISADecodeInfo, riscv32_ISADecodeInfo);
 
+#ifdef CONFIG_RV_SV32
+#define SATP_MODE_SV32 (1u << 31)
+#define SUPERPAGE_SHIFT 22 // 4 MiB megapages
+#define isa_mmu_check(vaddr, len, type) ((cpu.satp & SATP_MODE_SV32) ? MMU_TRANSLATE : MMU_DIRECT)
+#else
 #define isa_mmu_check(vaddr, len, type) (MMU_DIRECT)
+#endif
+
+// classes of the instruction mix
+enum { INST_ALU, INST_MULDIV, INST_LOAD, INST_STORE, INST_BRANCH, INST_JUMP,
+  INST_ATOMIC, INST_SYSTEM, INST_OTHER, NR_INST_CLASS };
 
 #endif
@@ -15,6 +15,7 @@
 
 #include <isa.h>
 #include <memory/paddr.h>
+#include <memory/vaddr.h>
 
 // this is not consistent with uint8_t
 // but it is ok since we do not access the array directly
@@ -32,9 +33,15 @@ static void restart() {
 
   /* The zero register is always 0. */
   cpu.gpr[0] = 0;
+
+  /* Start with the translation disabled and the TLBs empty. */
+  IFDEF(CONFIG_RV_SV32, cpu.satp = 0; tlb_flush());
 }
 
 void init_isa() {
+  /* Build the tables to decode instructions. */
+  isa_init_decode();
+
   /* Load built-in image. */
   memcpy(guest_to_host(RESET_VECTOR), img, sizeof(img));
 
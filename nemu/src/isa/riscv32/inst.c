@@ -17,10 +17,11 @@
 #include <cpu/cpu.h>
 #include <cpu/ifetch.h>
 #include <cpu/decode.h>
+#include <cpu/idcache.h>
+#include <memory/paddr.h>
+#include <memory/access.h>
 
 #define R(i) gpr(i)
-#define Mr vaddr_read
-#define Mw vaddr_write
 
 enum {
   TYPE_I, TYPE_U, TYPE_S, TYPE_J, TYPE_R, TYPE_B,
@@ -32,8 +33,8 @@ enum {
 #define immI() do { *imm = SEXT(BITS(i, 31, 20), 12); } while(0)
 #define immU() do { *imm = SEXT(BITS(i, 31, 12), 20) << 12; } while(0)
 #define immS() do { *imm = (SEXT(BITS(i, 31, 25), 7) << 5) | BITS(i, 11, 7); } while(0)
-#define immJ() do { *imm = SEXT((0 | (BITS(i, 30, 21) << 1) | (BITS(i, 20, 20) << 11) | (BITS(i, 19, 12) << 12) | (BITS(i, 31, 31) << 20)), 20); } while(0)
-#define immB() do { *imm = SEXT((0 | (BITS(i, 11, 8) << 1) | (BITS(i, 30, 25) << 5) | (BITS(i, 7, 7) << 11) | (BITS(i, 31, 31) << 12)), 12); } while(0)
+#define immJ() do { *imm = SEXT((0 | (BITS(i, 30, 21) << 1) | (BITS(i, 20, 20) << 11) | (BITS(i, 19, 12) << 12) | (BITS(i, 31, 31) << 20)), 21); } while(0)
+#define immB() do { *imm = SEXT((0 | (BITS(i, 11, 8) << 1) | (BITS(i, 30, 25) << 5) | (BITS(i, 7, 7) << 11) | (BITS(i, 31, 31) << 12)), 13); } while(0)
 
 static void decode_operand(Decode *s, int *rd, word_t *src1, word_t *src2, word_t *imm, int type) {
   uint32_t i = s->isa.inst.val;
@@ -50,21 +51,219 @@ static void decode_operand(Decode *s, int *rd, word_t *src1, word_t *src2, word_
   }
 }
 
+
+#ifdef CONFIG_INST_FUSION
+// check whether the instruction at `s->pc' forms a superinstruction with the
+// next one, the operands of the second instruction are decoded here as well
+static void fuse_detect(Decode *s, IDCacheEntry *e) {
+  uint32_t a = e->inst;
+  vaddr_t pc = s->pc;
+  // the next page may be unmapped if the guest never runs into it
+  if (e->rd == 0 || (pc & PAGE_MASK) == PAGE_SIZE - 4 || !in_pmem(pc + 4)) return;
+  Decode t = { .pc = pc + 4 };
+  t.isa.inst.val = vaddr_ifetch(pc + 4, 4);
+  uint32_t b = t.isa.inst.val;
+  int rd = 0;
+  word_t src1, src2, imm = 0;
+  int opc_a = BITS(a, 6, 0), f3_a = BITS(a, 14, 12);
+  int opc_b = BITS(b, 6, 0), f3_b = BITS(b, 14, 12);
+  bool b_reads_rd = (BITS(b, 19, 15) == e->rd);
+  int fuse = FUSE_NONE;
+
+  if (opc_a == 0x37 && opc_b == 0x13 && f3_b == 0 && b_reads_rd) {
+    decode_operand(&t, &rd, &src1, &src2, &imm, TYPE_I);
+    e->next.imm = e->imm + imm;
+    fuse = FUSE_LUI_ADDI;
+  } else if (opc_a == 0x17 && opc_b == 0x67 && f3_b == 0 && b_reads_rd) {
+    decode_operand(&t, &rd, &src1, &src2, &imm, TYPE_I);
+    e->next.imm = (pc + e->imm + imm) & ~1;
+    fuse = FUSE_AUIPC_JALR;
+  } else if (opc_a == 0x17 && opc_b == 0x03 && f3_b == 2 && b_reads_rd) {
+    decode_operand(&t, &rd, &src1, &src2, &imm, TYPE_I);
+    e->next.imm = pc + e->imm + imm;
+    fuse = FUSE_AUIPC_LW;
+  } else if (opc_b == 0x63 && f3_b != 2 && f3_b != 3) {
+    bool slt_i = (opc_a == 0x13), slt_r = (opc_a == 0x33 && BITS(a, 31, 25) == 0);
+    if (opc_a == 0x13 && f3_a == 0) fuse = FUSE_ADDI_BRANCH;
+    else if ((slt_i || slt_r) && f3_a == 2) fuse = FUSE_SLT_BRANCH;
+    else if ((slt_i || slt_r) && f3_a == 3) fuse = FUSE_SLTU_BRANCH;
+    else return;
+    decode_operand(&t, &rd, &src1, &src2, &imm, TYPE_B);
+    e->next.rs1 = BITS(b, 19, 15);
+    e->next.rs2 = BITS(b, 24, 20);
+    e->next.funct3 = f3_b;
+    e->next.imm = pc + 4 + imm;
+  } else {
+    return;
+  }
+  e->next.rd = rd;
+  e->fuse = fuse;
+  idcache_mark_code(pc + 4);
+}
+
+// execute the superinstruction in `e', the same as executing the two
+// instructions one after another
+static __attribute__((noinline)) void exec_fused(Decode *s, IDCacheEntry *e) {
+  s->snpc += 4;
+  s->dnpc = s->snpc;
+  switch (e->fuse) {
+    case FUSE_LUI_ADDI: R(e->rd) = e->imm; R(e->next.rd) = e->next.imm; break;
+    case FUSE_AUIPC_JALR: R(e->rd) = s->pc + e->imm; s->dnpc = e->next.imm; R(e->next.rd) = s->pc + 8; break;
+    case FUSE_AUIPC_LW: R(e->rd) = s->pc + e->imm; R(e->next.rd) = vaddr_read32(e->next.imm); break;
+    default: {
+      // for the I-type comparison rs2 is $zero, for the R-type one imm is 0
+      word_t src1 = R(e->rs1), src2 = R(e->rs2) + e->imm;
+      switch (e->fuse) {
+        case FUSE_ADDI_BRANCH: R(e->rd) = R(e->rs1) + e->imm; break;
+        case FUSE_SLT_BRANCH:  R(e->rd) = ((sword_t)src1 < (sword_t)src2); break;
+        case FUSE_SLTU_BRANCH: R(e->rd) = (src1 < src2); break;
+      }
+      word_t a = R(e->next.rs1), b = R(e->next.rs2);
+      bool taken = false;
+      switch (e->next.funct3) {
+        case 0: taken = (a == b); break;
+        case 1: taken = (a != b); break;
+        case 4: taken = ((sword_t)a < (sword_t)b); break;
+        case 5: taken = ((sword_t)a >= (sword_t)b); break;
+        case 6: taken = (a < b); break;
+        case 7: taken = (a >= b); break;
+      }
+      if (taken) s->dnpc = e->next.imm;
+    }
+  }
+  R(0) = 0;
+  g_nr_fuse[e->fuse] ++;
+}
+#endif
+
+// only the read-only mhartid, and satp with Sv32, are implemented
+static word_t csr_read(Decode *s, word_t no) {
+  switch (no & 0xfff) {
+    case 0xf14: return cpu.mhartid;
+    IFDEF(CONFIG_RV_SV32, case 0x180: return cpu.satp);
+  }
+  INV(s->pc);
+  return 0;
+}
+
+static void csr_write(Decode *s, word_t no, word_t val) {
+#ifdef CONFIG_RV_SV32
+  if ((no & 0xfff) == 0x180) {
+    // the address space is switched, there are no ASIDs in the TLBs
+    cpu.satp = val;
+    tlb_flush();
+    IFDEF(CONFIG_IDCACHE, idcache_flush());
+    return;
+  }
+#endif
+  INV(s->pc);
+}
+
+#ifdef CONFIG_RV_SV32
+// rs1 = $zero flushes all the pages, otherwise only the page of `vaddr'
+static void sfence_vma(Decode *s, vaddr_t vaddr) {
+  if (BITS(s->isa.inst.val, 19, 15) == 0) tlb_flush();
+  else tlb_flush_page(vaddr);
+  // the decode cache is indexed by the virtual pc
+  IFDEF(CONFIG_IDCACHE, idcache_flush());
+}
+#endif
+
+// the reservation set of lr.w, sc.w succeeds only if the word still holds
+// the loaded value, which is enough for the usual lock-free sequences
+static HART_LOCAL struct { paddr_t addr; word_t val; bool valid; } reservation = {};
+
+enum { AMO_SWAP, AMO_ADD, AMO_XOR, AMO_AND, AMO_OR, AMO_MIN, AMO_MAX, AMO_MINU, AMO_MAXU, AMO_SC };
+
+// atomically apply `op' to the word at `addr', return the old value
+static word_t amo(Decode *s, vaddr_t vaddr, int op, word_t src) {
+  paddr_t addr = MUXDEF(CONFIG_TLB, vaddr_translate(vaddr, MEM_TYPE_WRITE), vaddr);
+  Assert(in_pmem(addr) && (addr & 3) == 0,
+      "atomic access at unsupported address " FMT_WORD " at pc = " FMT_WORD, vaddr, s->pc);
+  IFDEF(CONFIG_IDCACHE, if (unlikely(idcache_check_page(addr))) idcache_flush());
+  word_t *p = (word_t *)guest_to_host(addr);
+  if (op == AMO_SC) {
+    bool ok = reservation.valid && reservation.addr == addr;
+    word_t expected = reservation.val;
+    reservation.valid = false;
+    ok = ok && __atomic_compare_exchange_n(p, &expected, src, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return !ok;
+  }
+  word_t old = __atomic_load_n(p, __ATOMIC_SEQ_CST), new = 0;
+  do {
+    switch (op) {
+      case AMO_SWAP: new = src; break;
+      case AMO_ADD:  new = old + src; break;
+      case AMO_XOR:  new = old ^ src; break;
+      case AMO_AND:  new = old & src; break;
+      case AMO_OR:   new = old | src; break;
+      case AMO_MIN:  new = ((sword_t)old < (sword_t)src ? old : src); break;
+      case AMO_MAX:  new = ((sword_t)old > (sword_t)src ? old : src); break;
+      case AMO_MINU: new = (old < src ? old : src); break;
+      case AMO_MAXU: new = (old > src ? old : src); break;
+    }
+  } while (!__atomic_compare_exchange_n(p, &old, new, true, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+  return old;
+}
+
+static word_t lr(Decode *s, vaddr_t vaddr) {
+  paddr_t addr = MUXDEF(CONFIG_TLB, vaddr_translate(vaddr, MEM_TYPE_READ), vaddr);
+  Assert(in_pmem(addr) && (addr & 3) == 0,
+      "atomic access at unsupported address " FMT_WORD " at pc = " FMT_WORD, vaddr, s->pc);
+  reservation.addr = addr;
+  reservation.val = __atomic_load_n((word_t *)guest_to_host(addr), __ATOMIC_SEQ_CST);
+  reservation.valid = true;
+  return reservation.val;
+}
+
+#ifdef CONFIG_IDCACHE
+static void idcache_fill_operand(Decode *s, int rd, word_t imm, int type, const void *exec) {
+  uint32_t i = s->isa.inst.val;
+  // operands which are not read by this type are pointed to $zero
+  bool has_src1 = (type == TYPE_I || type == TYPE_S || type == TYPE_R || type == TYPE_B);
+  bool has_src2 = (type == TYPE_S || type == TYPE_R || type == TYPE_B);
+  idcache_fill(s->de, i, s->snpc - s->pc, rd,
+      has_src1 ? BITS(i, 19, 15) : 0, has_src2 ? BITS(i, 24, 20) : 0, imm, exec);
+  IFDEF(CONFIG_INST_COUNT, s->de->pat = s->pat);
+  IFDEF(CONFIG_INST_FUSION, fuse_detect(s, s->de));
+}
+#endif
+
 static int decode_exec(Decode *s) {
   int rd = 0;
   word_t src1 = 0, src2 = 0, imm = 0;
   s->dnpc = s->snpc;
+  IFDEF(CONFIG_INST_FUSION, bool fuse = s->fuse; s->fuse = false);
 
 #define INSTPAT_INST(s) ((s)->isa.inst.val)
 #define INSTPAT_MATCH(s, name, type, ... /* execute body */ ) { \
   decode_operand(s, &rd, &src1, &src2, &imm, concat(TYPE_, type)); \
+  IFDEF(CONFIG_IDCACHE, idcache_fill_operand(s, rd, imm, concat(TYPE_, type), &&concat(__instpat_exec_, name)); \
+  concat(__instpat_exec_, name): ); \
   __VA_ARGS__ ; \
 }
 
+#ifdef CONFIG_IDCACHE
+  IDCacheEntry *e = s->de;
+  if (e->exec != NULL) {
+    // hit in the decode cache, skip the operand decoding and pattern matching
+    rd = e->rd; src1 = R(e->rs1); src2 = R(e->rs2); imm = e->imm;
+    IFDEF(CONFIG_INST_COUNT, s->pat = e->pat);
+#ifdef CONFIG_INST_FUSION
+    if (fuse && e->fuse != FUSE_NONE) {
+      s->fuse = true;
+      exec_fused(s, e);
+      return 0;
+    }
+#endif
+    goto *e->exec;
+  }
+#endif
+
   INSTPAT_START();
   INSTPAT("??????? ????? ????? ??? ????? 00101 11", auipc  , U, R(rd) = s->pc + imm);
-  INSTPAT("??????? ????? ????? 100 ????? 00000 11", lbu    , I, R(rd) = Mr(src1 + imm, 1));
-  INSTPAT("??????? ????? ????? 000 ????? 01000 11", sb     , S, Mw(src1 + imm, 1, src2));
+  INSTPAT("??????? ????? ????? 100 ????? 00000 11", lbu    , I, R(rd) = vaddr_read8(src1 + imm));
+  INSTPAT("??????? ????? ????? 000 ????? 01000 11", sb     , S, vaddr_write8(src1 + imm, src2));
 
   // copy from my ics2022
   INSTPAT("??????? ????? ????? ??? ????? 01101 11", lui    , U, R(rd) = imm);
@@ -76,12 +275,12 @@ static int decode_exec(Decode *s) {
   INSTPAT("??????? ????? ????? 101 ????? 11000 11", bge    , B, if ((sword_t)src1 >= (sword_t)src2) s->dnpc += imm - 4);
   INSTPAT("??????? ????? ????? 110 ????? 11000 11", bltu   , B, if (src1 < src2) s->dnpc += imm - 4);
   INSTPAT("??????? ????? ????? 111 ????? 11000 11", bgeu   , B, if (src1 >= src2) s->dnpc += imm - 4);
-  INSTPAT("??????? ????? ????? 000 ????? 00000 11", lb     , I, R(rd) = Mr(src1 + imm, 'b'));
-  INSTPAT("??????? ????? ????? 001 ????? 00000 11", lh     , I, R(rd) = Mr(src1 + imm, 'h'));
-  INSTPAT("??????? ????? ????? 010 ????? 00000 11", lw     , I, R(rd) = Mr(src1 + imm, 4));
-  INSTPAT("??????? ????? ????? 101 ????? 00000 11", lhu    , I, R(rd) = Mr(src1 + imm, 2));
-  INSTPAT("??????? ????? ????? 001 ????? 01000 11", sh     , S, Mw(src1 + imm, 2, src2));
-  INSTPAT("??????? ????? ????? 010 ????? 01000 11", sw     , S, Mw(src1 + imm, 4, src2));
+  INSTPAT("??????? ????? ????? 000 ????? 00000 11", lb     , I, R(rd) = SEXT(vaddr_read8(src1 + imm), 8));
+  INSTPAT("??????? ????? ????? 001 ????? 00000 11", lh     , I, R(rd) = SEXT(vaddr_read16(src1 + imm), 16));
+  INSTPAT("??????? ????? ????? 010 ????? 00000 11", lw     , I, R(rd) = vaddr_read32(src1 + imm));
+  INSTPAT("??????? ????? ????? 101 ????? 00000 11", lhu    , I, R(rd) = vaddr_read16(src1 + imm));
+  INSTPAT("??????? ????? ????? 001 ????? 01000 11", sh     , S, vaddr_write16(src1 + imm, src2));
+  INSTPAT("??????? ????? ????? 010 ????? 01000 11", sw     , S, vaddr_write32(src1 + imm, src2));
   INSTPAT("??????? ????? ????? 000 ????? 00100 11", addi   , I, R(rd) = src1 + imm);
   INSTPAT("??????? ????? ????? 010 ????? 00100 11", slti   , I, ((sword_t)src1 < (sword_t)imm) ? (R(rd) = 1) : (R(rd) = 0));
   INSTPAT("??????? ????? ????? 011 ????? 00100 11", sltiu  , I, (src1 < imm) ? (R(rd) = 1) : (R(rd) = 0));
@@ -110,6 +309,25 @@ static int decode_exec(Decode *s) {
   INSTPAT("0000001 ????? ????? 110 ????? 01100 11", rem    , R, R(rd) = ((sword_t)src1 % (sword_t)src2));
   INSTPAT("0000001 ????? ????? 111 ????? 01100 11", remu   , R, R(rd) = ((sword_t)src1 % src2)); // src1需要是unsigned?
 
+  INSTPAT("00010?? 00000 ????? 010 ????? 01011 11", lr_w      , R, R(rd) = lr(s, src1));
+  INSTPAT("00011?? ????? ????? 010 ????? 01011 11", sc_w      , R, R(rd) = amo(s, src1, AMO_SC, src2));
+  INSTPAT("00001?? ????? ????? 010 ????? 01011 11", amoswap_w , R, R(rd) = amo(s, src1, AMO_SWAP, src2));
+  INSTPAT("00000?? ????? ????? 010 ????? 01011 11", amoadd_w  , R, R(rd) = amo(s, src1, AMO_ADD, src2));
+  INSTPAT("00100?? ????? ????? 010 ????? 01011 11", amoxor_w  , R, R(rd) = amo(s, src1, AMO_XOR, src2));
+  INSTPAT("01100?? ????? ????? 010 ????? 01011 11", amoand_w  , R, R(rd) = amo(s, src1, AMO_AND, src2));
+  INSTPAT("01000?? ????? ????? 010 ????? 01011 11", amoor_w   , R, R(rd) = amo(s, src1, AMO_OR, src2));
+  INSTPAT("10000?? ????? ????? 010 ????? 01011 11", amomin_w  , R, R(rd) = amo(s, src1, AMO_MIN, src2));
+  INSTPAT("10100?? ????? ????? 010 ????? 01011 11", amomax_w  , R, R(rd) = amo(s, src1, AMO_MAX, src2));
+  INSTPAT("11000?? ????? ????? 010 ????? 01011 11", amominu_w , R, R(rd) = amo(s, src1, AMO_MINU, src2));
+  INSTPAT("11100?? ????? ????? 010 ????? 01011 11", amomaxu_w , R, R(rd) = amo(s, src1, AMO_MAXU, src2));
+
+  INSTPAT("??????? ????? ????? 001 ????? 11100 11", csrrw  , I, word_t t = (rd != 0 ? csr_read(s, imm) : 0); csr_write(s, imm, src1); R(rd) = t);
+  INSTPAT("??????? ????? ????? 010 ????? 11100 11", csrrs  , I, word_t t = csr_read(s, imm); if (BITS(s->isa.inst.val, 19, 15) != 0) csr_write(s, imm, t | src1); R(rd) = t);
+  INSTPAT("??????? ????? ????? 011 ????? 11100 11", csrrc  , I, word_t t = csr_read(s, imm); if (BITS(s->isa.inst.val, 19, 15) != 0) csr_write(s, imm, t & ~src1); R(rd) = t);
+
+#ifdef CONFIG_RV_SV32
+  INSTPAT("0001001 ????? ????? 000 00000 11100 11", sfence_vma, R, sfence_vma(s, src1));
+#endif
   INSTPAT("0000000 00001 00000 000 00000 11100 11", ebreak , N, NEMUTRAP(s->pc, R(10))); // R(10) is $a0
   INSTPAT("??????? ????? ????? ??? ????? ????? ??", inv    , N, INV(s->pc));
 
@@ -120,7 +338,56 @@ static int decode_exec(Decode *s) {
   return 0;
 }
 
+#ifdef CONFIG_INST_MIX
+const char *isa_inst_class_name[] = {
+  [INST_ALU] = "alu", [INST_MULDIV] = "mul/div", [INST_LOAD] = "load", [INST_STORE] = "store",
+  [INST_BRANCH] = "branch", [INST_JUMP] = "jump", [INST_ATOMIC] = "atomic", [INST_SYSTEM] = "system",
+  [INST_OTHER] = "other",
+};
+
+// classify the executed instruction by its major opcode
+int isa_inst_class(Decode *s) {
+  uint32_t i = s->isa.inst.val;
+  switch (BITS(i, 6, 0)) {
+    case 0x37: case 0x17: case 0x13: return INST_ALU;
+    case 0x33: return (BITS(i, 31, 25) == 1 ? INST_MULDIV : INST_ALU);
+    case 0x03: return INST_LOAD;
+    case 0x23: return INST_STORE;
+    case 0x63: return INST_BRANCH;
+    case 0x6f: case 0x67: return INST_JUMP;
+    case 0x2f: return INST_ATOMIC;
+    case 0x73: case 0x0f: return INST_SYSTEM;
+    default: return INST_OTHER;
+  }
+}
+#endif
+
+#ifdef CONFIG_INST_COUNT
+// bytes accessed by a load or store, encoded in the low bits of funct3
+int isa_inst_mem_width(Decode *s) {
+  return 1 << BITS(s->isa.inst.val, 13, 12);
+}
+#endif
+
+// execute decode_exec() once to build its table of patterns
+void isa_init_decode() {
+  static bool ready = false;
+  if (ready) return;
+  ready = true;
+  IFDEF(CONFIG_IDCACHE, IDCacheEntry e = {});
+  Decode s = { IFDEF(CONFIG_IDCACHE, .de = &e) };
+  decode_exec(&s);
+}
+
 int isa_exec_once(Decode *s) {
+#ifdef CONFIG_IDCACHE
+  // `s->de' is prepared by the engine
+  if (s->de->exec != NULL) {
+    s->isa.inst.val = s->de->inst;
+    s->snpc += s->de->ilen;
+    return decode_exec(s);
+  }
+#endif
   s->isa.inst.val = inst_fetch(&s->snpc, 4);
   return decode_exec(s);
 }
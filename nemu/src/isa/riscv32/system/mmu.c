@@ -17,6 +17,43 @@
 #include <memory/vaddr.h>
 #include <memory/paddr.h>
 
+#ifdef CONFIG_RV_SV32
+
+enum { PTE_V = 0x1, PTE_R = 0x2, PTE_W = 0x4, PTE_X = 0x8, PTE_A = 0x40, PTE_D = 0x80 };
+
+#define PTE_PPN(pte) ((paddr_t)((pte) >> 10) << PAGE_SHIFT)
+#define VPN(vaddr, level) BITS(vaddr, 21 + (level) * 10, 12 + (level) * 10)
+
+// Walk the Sv32 page tables, return the physical page of `vaddr' with
+// MEM_RET_OK in the page offset, and MEM_RET_SUPERPAGE for a megapage, or
+// MEM_RET_FAIL for a page fault. The privilege modes are not implemented,
+// so the U bit is not checked.
+paddr_t isa_mmu_translate(vaddr_t vaddr, int len, int type) {
+  paddr_t table = (paddr_t)BITS(cpu.satp, 21, 0) << PAGE_SHIFT;
+  for (int level = 1; level >= 0; level --) {
+    paddr_t pte_addr = table + VPN(vaddr, level) * 4;
+    word_t pte = paddr_read(pte_addr, 4);
+    if (!(pte & PTE_V) || ((pte & PTE_W) && !(pte & PTE_R))) return MEM_RET_FAIL;
+    if (!(pte & (PTE_R | PTE_X))) {
+      table = PTE_PPN(pte);
+      continue;
+    }
+
+    // a leaf
+    int need = (type == MEM_TYPE_IFETCH ? PTE_X : type == MEM_TYPE_READ ? PTE_R : PTE_W);
+    if (!(pte & need)) return MEM_RET_FAIL;
+    if (level == 1 && BITS(pte, 19, 10) != 0) return MEM_RET_FAIL; // misaligned megapage
+    word_t new_pte = pte | PTE_A | (type == MEM_TYPE_WRITE ? PTE_D : 0);
+    if (new_pte != pte) paddr_write(pte_addr, 4, new_pte);
+    paddr_t page = PTE_PPN(pte);
+    if (level == 1) return page | (VPN(vaddr, 0) << PAGE_SHIFT) | MEM_RET_OK | MEM_RET_SUPERPAGE;
+    return page | MEM_RET_OK;
+  }
+  return MEM_RET_FAIL;
+}
+
+#else
 paddr_t isa_mmu_translate(vaddr_t vaddr, int len, int type) {
   return MEM_RET_FAIL;
 }
+#endif
@@ -0,0 +1,92 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <memory/paddr.h>
+#include <memory/vaddr.h>
+#include <memory/dirty.h>
+#include <memory/sparse.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define NR_PAGE (CONFIG_MSIZE >> PAGE_SHIFT)
+
+static uint8_t dirty[NR_PAGE] = {};
+static bool tracking = false;
+static struct sigaction old_action;
+
+static void segv_handler(int signum, siginfo_t *info, void *ucontext) {
+  uint8_t *base = guest_to_host(CONFIG_MBASE);
+  uint8_t *p = info->si_addr;
+  if (tracking && p >= base && p < base + CONFIG_MSIZE) {
+    size_t idx = (p - base) >> PAGE_SHIFT;
+    dirty[idx] = 1;
+    IFDEF(CONFIG_PMEM_SPARSE, sparse_fill_page(idx));
+    // the faulting store is executed again after returning
+    if (mprotect(base + (idx << PAGE_SHIFT), PAGE_SIZE, PROT_READ | PROT_WRITE) == 0) return;
+  }
+  // a real fault, let the previous handler report it when it happens again
+  sigaction(SIGSEGV, &old_action, NULL);
+}
+
+static int protect(int prot) {
+  uint8_t *base = guest_to_host(CONFIG_MBASE);
+#ifdef CONFIG_PMEM_SPARSE
+  // the untouched pages of sparse pmem are left inaccessible
+  for (size_t l = 0, r; l < NR_PAGE; l = r + 1) {
+    for (r = l; r < NR_PAGE && sparse_touched(base + (r << PAGE_SHIFT)); r ++) ;
+    if (r > l && mprotect(base + (l << PAGE_SHIFT), (r - l) << PAGE_SHIFT, prot) != 0) return -1;
+  }
+  return 0;
+#else
+  return mprotect(base, CONFIG_MSIZE, prot);
+#endif
+}
+
+bool dirty_track_start() {
+#if defined(CONFIG_TARGET_LIB) || defined(CONFIG_SMP)
+  return false;
+#endif
+  if (sysconf(_SC_PAGESIZE) != PAGE_SIZE) return false;
+  if (!tracking) {
+    struct sigaction s;
+    memset(&s, 0, sizeof(s));
+    s.sa_sigaction = segv_handler;
+    s.sa_flags = SA_SIGINFO;
+    int ret = sigaction(SIGSEGV, &s, &old_action);
+    Assert(ret == 0, "Can not set signal handler");
+  }
+  memset(dirty, 0, sizeof(dirty));
+  int ret = protect(PROT_READ);
+  Assert(ret == 0, "Can not protect pmem to track dirty pages");
+  tracking = true;
+  return true;
+}
+
+void dirty_track_stop() {
+  if (!tracking) return;
+  int ret = protect(PROT_READ | PROT_WRITE);
+  Assert(ret == 0, "Can not unprotect pmem");
+  sigaction(SIGSEGV, &old_action, NULL);
+  tracking = false;
+}
+
+bool dirty_tracking() {
+  return tracking;
+}
+
+bool dirty_page(size_t idx) {
+  return dirty[idx];
+}
@@ -15,17 +15,23 @@
 
 #include <memory/host.h>
 #include <memory/paddr.h>
+#include <memory/sparse.h>
 #include <device/mmio.h>
+#include <cpu/cpu.h>
+#include <cpu/idcache.h>
+#include <cpu/difftest.h>
 #include <isa.h>
 
-#if   defined(CONFIG_PMEM_MALLOC)
-static uint8_t *pmem = NULL;
+#if   defined(CONFIG_PMEM_MALLOC) || defined(CONFIG_PMEM_SPARSE)
+MACHINE_LOCAL uint8_t *pmem = NULL;
 #else // CONFIG_PMEM_GARRAY
-static uint8_t pmem[CONFIG_MSIZE] PG_ALIGN = {};
+uint8_t pmem[CONFIG_MSIZE] PG_ALIGN = {};
 #endif
 
-uint8_t* guest_to_host(paddr_t paddr) { return pmem + paddr - CONFIG_MBASE; }
-paddr_t host_to_guest(uint8_t *haddr) { return haddr - pmem + CONFIG_MBASE; }
+#ifdef CONFIG_TARGET_LIB
+// switch to the memory of the machine run by this thread
+void set_pmem(uint8_t *p) { pmem = p; }
+#endif
 
 static word_t pmem_read(paddr_t addr, int len) {
   word_t ret = host_read(guest_to_host(addr), len);
@@ -33,32 +39,53 @@ static word_t pmem_read(paddr_t addr, int len) {
 }
 
 static void pmem_write(paddr_t addr, int len, word_t data) {
+  IFDEF(CONFIG_IDCACHE, if (unlikely(idcache_check_page(addr))) idcache_flush());
   host_write(guest_to_host(addr), len, data);
 }
 
 static void out_of_bound(paddr_t addr) {
+#ifdef CONFIG_TARGET_LIB
+  // only stop this machine, not the whole process
+  Log("address = " FMT_PADDR " is out of bound of pmem at pc = " FMT_WORD, addr, cpu.pc);
+  set_nemu_state(NEMU_ABORT, cpu.pc, -1);
+  return;
+#endif
   panic("address = " FMT_PADDR " is out of bound of pmem [" FMT_PADDR ", " FMT_PADDR "] at pc = " FMT_WORD,
       addr, PMEM_LEFT, PMEM_RIGHT, cpu.pc);
 }
 
 void init_mem() {
 #if   defined(CONFIG_PMEM_MALLOC)
-  pmem = malloc(CONFIG_MSIZE);
+  // page aligned, so that the pages can be protected to track the dirty ones
+  pmem = MUXDEF(CONFIG_TARGET_AM, malloc(CONFIG_MSIZE), aligned_alloc(4096, CONFIG_MSIZE));
   assert(pmem);
+#elif defined(CONFIG_PMEM_SPARSE)
+  pmem = sparse_init();
 #endif
-  IFDEF(CONFIG_MEM_RANDOM, memset(pmem, rand(), CONFIG_MSIZE));
+  // sparse pmem fills the random value page by page when touched
+  IFNDEF(CONFIG_PMEM_SPARSE, IFDEF(CONFIG_MEM_RANDOM, memset(pmem, rand(), CONFIG_MSIZE)));
   Log("physical memory area [" FMT_PADDR ", " FMT_PADDR "]", PMEM_LEFT, PMEM_RIGHT);
 }
 
 word_t paddr_read(paddr_t addr, int len) {
-  if (likely(in_pmem(addr))) return pmem_read(addr, len);
-  IFDEF(CONFIG_DEVICE, return mmio_read(addr, len));
+  if (likely(in_pmem_range(addr, len))) return pmem_read(addr, len);
+#ifdef CONFIG_DEVICE
+  // device memory without a callback (e.g. the frame buffer) is read as RAM
+  uint8_t *host = mmio_host(addr, len);
+  if (likely(host != NULL)) { difftest_skip_ref(); return host_read(host, len); }
+  return mmio_read(addr, len);
+#endif
   out_of_bound(addr);
   return 0;
 }
 
 void paddr_write(paddr_t addr, int len, word_t data) {
-  if (likely(in_pmem(addr))) { pmem_write(addr, len, data); return; }
-  IFDEF(CONFIG_DEVICE, mmio_write(addr, len, data); return);
+  if (likely(in_pmem_range(addr, len))) { pmem_write(addr, len, data); return; }
+#ifdef CONFIG_DEVICE
+  uint8_t *host = mmio_host(addr, len);
+  if (likely(host != NULL)) { difftest_skip_ref(); host_write(host, len, data); return; }
+  mmio_write(addr, len, data);
+  return;
+#endif
   out_of_bound(addr);
 }
@@ -0,0 +1,101 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <memory/paddr.h>
+#include <memory/vaddr.h>
+#include <memory/sparse.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#ifdef CONFIG_PMEM_SPARSE
+
+#define NR_PAGE (CONFIG_MSIZE >> PAGE_SHIFT)
+
+#ifdef CONFIG_MEM_RANDOM
+static uint8_t touched[NR_PAGE] = {};
+static uint8_t fill = 0;
+static int fill_lock = 0; // harts may fault on the same page at the same time
+static struct sigaction old_action;
+
+static void segv_handler(int signum, siginfo_t *info, void *ucontext) {
+  uint8_t *p = info->si_addr;
+  if (p >= pmem && p < pmem + CONFIG_MSIZE) {
+    // the faulting access is executed again after returning
+    sparse_fill_page((p - pmem) >> PAGE_SHIFT);
+    return;
+  }
+  // a real fault, let the previous handler report it when it happens again
+  sigaction(SIGSEGV, &old_action, NULL);
+}
+#endif
+
+void sparse_fill_page(size_t idx) {
+#ifdef CONFIG_MEM_RANDOM
+  if (__atomic_load_n(&touched[idx], __ATOMIC_ACQUIRE)) return;
+  while (__atomic_exchange_n(&fill_lock, 1, __ATOMIC_ACQUIRE)) ;
+  if (!touched[idx]) {
+    uint8_t *p = pmem + (idx << PAGE_SHIFT);
+    int ret = mprotect(p, PAGE_SIZE, PROT_READ | PROT_WRITE);
+    Assert(ret == 0, "Can not allocate the page at " FMT_PADDR, (paddr_t)(CONFIG_MBASE + (idx << PAGE_SHIFT)));
+    memset(p, fill, PAGE_SIZE);
+    __atomic_store_n(&touched[idx], 1, __ATOMIC_RELEASE);
+  }
+  __atomic_store_n(&fill_lock, 0, __ATOMIC_RELEASE);
+#endif
+}
+
+bool sparse_touched(uint8_t *p) {
+  if (p < pmem || p >= pmem + CONFIG_MSIZE) return true;
+  return MUXDEF(CONFIG_MEM_RANDOM, touched[(p - pmem) >> PAGE_SHIFT], true);
+}
+
+void sparse_touch(uint8_t *p, size_t len) {
+  uint8_t *end = pmem + CONFIG_MSIZE;
+  if (len == 0 || p >= end || p + len <= pmem) return;
+  size_t first = ((p > pmem ? p : pmem) - pmem) >> PAGE_SHIFT;
+  size_t last = ((p + len < end ? p + len : end) - 1 - pmem) >> PAGE_SHIFT;
+  for (size_t idx = first; idx <= last; idx ++) sparse_fill_page(idx);
+}
+
+void sparse_clear() {
+  // the dropped pages are allocated again, filled with zero, when touched
+  int ret = madvise(pmem, CONFIG_MSIZE, MADV_DONTNEED);
+  Assert(ret == 0, "Can not drop the pages of pmem");
+#ifdef CONFIG_MEM_RANDOM
+  ret = mprotect(pmem, CONFIG_MSIZE, PROT_READ | PROT_WRITE);
+  Assert(ret == 0, "Can not unprotect pmem");
+  memset(touched, 1, sizeof(touched));
+#endif
+}
+
+uint8_t* sparse_init() {
+  int prot = MUXDEF(CONFIG_MEM_RANDOM, PROT_NONE, PROT_READ | PROT_WRITE);
+  uint8_t *p = mmap(NULL, CONFIG_MSIZE, prot, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  Assert(p != MAP_FAILED, "Can not reserve %#lx bytes for pmem", (unsigned long)CONFIG_MSIZE);
+#ifdef CONFIG_MEM_RANDOM
+  Assert(sysconf(_SC_PAGESIZE) == PAGE_SIZE, "The host page size is not %lu", PAGE_SIZE);
+  fill = rand();
+  struct sigaction s;
+  memset(&s, 0, sizeof(s));
+  s.sa_sigaction = segv_handler;
+  s.sa_flags = SA_SIGINFO;
+  int ret = sigaction(SIGSEGV, &s, &old_action);
+  Assert(ret == 0, "Can not set signal handler");
+#endif
+  return p;
+}
+
+#endif
@@ -15,15 +15,136 @@
 
 #include <isa.h>
 #include <memory/paddr.h>
+#include <memory/host.h>
+#include <cpu/idcache.h>
+#include <device/mmio.h>
+
+#ifdef CONFIG_TLB
+
+// Direct-mapped TLBs indexed by the virtual page. An entry caches the
+// physical page and, if the page can be accessed as RAM, its host address,
+// so a hit is a tag compare and a host access.
+#define TLB_SIZE 256
+#define TLB_INVALID 1 // never equal to a page-aligned address
+#define SUPERPAGE_MASK (((vaddr_t)1 << SUPERPAGE_SHIFT) - 1)
+
+typedef struct {
+  vaddr_t tag;      // virtual page which can be read (or fetched)
+  vaddr_t wtag;     // virtual page which can be written without updating the PTE
+  paddr_t ppage;
+  uint8_t *host;    // NULL if the page is not in pmem or plain device memory
+  bool superpage;   // the page is a slice of a superpage
+} TLBEntry;
+
+static HART_LOCAL TLBEntry itlb[TLB_SIZE], dtlb[TLB_SIZE];
+static HART_LOCAL bool has_superpage = false; // some entries are slices of superpages
+
+static void tlb_invalidate(TLBEntry *e) {
+  e->tag = e->wtag = TLB_INVALID;
+}
+
+void tlb_flush() {
+  for (int i = 0; i < TLB_SIZE; i ++) {
+    tlb_invalidate(&itlb[i]);
+    tlb_invalidate(&dtlb[i]);
+  }
+  has_superpage = false;
+}
+
+static void flush_superpage(TLBEntry *e, vaddr_t base) {
+  if (e->superpage && (e->tag & ~SUPERPAGE_MASK) == base) tlb_invalidate(e);
+}
+
+void tlb_flush_page(vaddr_t vaddr) {
+  vaddr_t vpage = vaddr & ~PAGE_MASK;
+  int idx = (vaddr >> PAGE_SHIFT) & (TLB_SIZE - 1);
+  if (itlb[idx].tag == vpage) tlb_invalidate(&itlb[idx]);
+  if (dtlb[idx].tag == vpage) tlb_invalidate(&dtlb[idx]);
+  if (!has_superpage) return;
+  // the slices of a superpage are spread over all the entries
+  vaddr_t base = vaddr & ~SUPERPAGE_MASK;
+  for (int i = 0; i < TLB_SIZE; i ++) {
+    flush_superpage(&itlb[i], base);
+    flush_superpage(&dtlb[i], base);
+  }
+}
+
+static TLBEntry* tlb_lookup(vaddr_t addr, int type) {
+  vaddr_t vpage = addr & ~PAGE_MASK;
+  int idx = (addr >> PAGE_SHIFT) & (TLB_SIZE - 1);
+  TLBEntry *e = (type == MEM_TYPE_IFETCH ? &itlb[idx] : &dtlb[idx]);
+  if (likely((type == MEM_TYPE_WRITE ? e->wtag : e->tag) == vpage)) return e;
+
+  paddr_t ret = isa_mmu_translate(vpage, 1, type);
+  if (unlikely((ret & PAGE_MASK & ~MEM_RET_SUPERPAGE) != MEM_RET_OK)) {
+    panic("page fault at vaddr = " FMT_WORD " (%s) at pc = " FMT_WORD, addr,
+        (type == MEM_TYPE_IFETCH ? "fetch" : type == MEM_TYPE_READ ? "read" : "write"), cpu.pc);
+  }
+  e->tag = vpage;
+  // a write walk has set the dirty bit, and writable pages are also readable
+  e->wtag = (type == MEM_TYPE_WRITE ? vpage : TLB_INVALID);
+  e->ppage = ret & ~PAGE_MASK;
+  e->superpage = (ret & MEM_RET_SUPERPAGE) != 0;
+  has_superpage |= e->superpage;
+  e->host = (in_pmem(e->ppage) ? guest_to_host(e->ppage) : NULL);
+#if defined(CONFIG_DEVICE) && !defined(CONFIG_DIFFTEST)
+  // device memory without a callback is accessed as RAM, unless the
+  // reference has to skip the accesses
+  if (e->host == NULL) e->host = mmio_host(e->ppage, PAGE_SIZE);
+#endif
+  return e;
+}
+
+paddr_t vaddr_translate(vaddr_t addr, int type) {
+  if (isa_mmu_check(addr, 1, type) != MMU_TRANSLATE) return addr;
+  return tlb_lookup(addr, type)->ppage | (addr & PAGE_MASK);
+}
+
+static word_t tlb_read(vaddr_t addr, int len, int type) {
+  if (unlikely((addr & PAGE_MASK) + len > PAGE_SIZE)) {
+    // split the access across the page boundary into bytes
+    word_t data = 0;
+    for (int i = 0; i < len; i ++) data |= tlb_read(addr + i, 1, type) << (i * 8);
+    return data;
+  }
+  TLBEntry *e = tlb_lookup(addr, type);
+  if (likely(e->host != NULL)) return host_read(e->host + (addr & PAGE_MASK), len);
+  return paddr_read(e->ppage | (addr & PAGE_MASK), len);
+}
+
+static void tlb_write(vaddr_t addr, int len, word_t data) {
+  if (unlikely((addr & PAGE_MASK) + len > PAGE_SIZE)) {
+    for (int i = 0; i < len; i ++) tlb_write(addr + i, 1, data >> (i * 8));
+    return;
+  }
+  TLBEntry *e = tlb_lookup(addr, MEM_TYPE_WRITE);
+  paddr_t paddr = e->ppage | (addr & PAGE_MASK);
+  if (likely(e->host != NULL)) {
+    IFDEF(CONFIG_IDCACHE, if (unlikely(in_pmem(paddr) && idcache_check_page(paddr))) idcache_flush());
+    host_write(e->host + (addr & PAGE_MASK), len, data);
+    return;
+  }
+  paddr_write(paddr, len, data);
+}
+
+#define TRANSLATE(addr, len, type) (isa_mmu_check(addr, len, type) == MMU_TRANSLATE)
+#else
+#define TRANSLATE(addr, len, type) false
+#define tlb_read(addr, len, type) 0
+#define tlb_write(addr, len, data)
+#endif
 
 word_t vaddr_ifetch(vaddr_t addr, int len) {
+  if (TRANSLATE(addr, len, MEM_TYPE_IFETCH)) return tlb_read(addr, len, MEM_TYPE_IFETCH);
   return paddr_read(addr, len);
 }
 
 word_t vaddr_read(vaddr_t addr, int len) {
+  if (TRANSLATE(addr, len, MEM_TYPE_READ)) return tlb_read(addr, len, MEM_TYPE_READ);
   return paddr_read(addr, len);
 }
 
 void vaddr_write(vaddr_t addr, int len, word_t data) {
+  if (TRANSLATE(addr, len, MEM_TYPE_WRITE)) { tlb_write(addr, len, data); return; }
   paddr_write(addr, len, data);
 }
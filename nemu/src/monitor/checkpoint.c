@@ -0,0 +1,197 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <isa.h>
+#include <checkpoint.h>
+#include <cpu/idcache.h>
+#include <memory/paddr.h>
+#include <memory/dirty.h>
+#include <memory/sparse.h>
+
+#define CKPT_VERSION 1
+#define CKPT_PAGE_END 0xffffffffu
+
+struct Checkpoint {
+  FILE *fp;
+  bool save;
+  bool delta; // only the pages written since the last checkpoint are saved
+  bool error; // the following operations are skipped after an error
+};
+
+extern HART_LOCAL uint64_t g_nr_guest_inst;
+// the instruction count of the last checkpoint, which is the parent of the
+// next delta, -1 before the first checkpoint
+static uint64_t last_ckpt = -1;
+static bool track_delta = false;
+void device_checkpoint(Checkpoint *c);
+
+bool ckpt_saving(Checkpoint *c) {
+  return c->save;
+}
+
+void ckpt_data(Checkpoint *c, void *buf, size_t len) {
+  if (c->error || len == 0) return;
+  size_t ret = (c->save ? fwrite(buf, len, 1, c->fp) : fread(buf, len, 1, c->fp));
+  if (ret != 1) c->error = true;
+}
+
+static bool page_is_zero(uint8_t *p) {
+  // an untouched page of sparse pmem is not saved, instead of being filled by reading it
+  IFDEF(CONFIG_PMEM_SPARSE, if (!sparse_touched(p)) return true);
+  for (int i = 0; i < PAGE_SIZE; i += sizeof(uint64_t)) {
+    if (*(uint64_t *)(p + i) != 0) return false;
+  }
+  return true;
+}
+
+static void clear_pages(uint8_t *p, size_t len) {
+#ifdef CONFIG_PMEM_SPARSE
+  // the pages of sparse pmem are dropped instead of touching all of them
+  if (p == guest_to_host(CONFIG_MBASE)) { sparse_clear(); return; }
+#endif
+  memset(p, 0, len);
+}
+
+// only the dirty pages with `delta', or the pages which are not all zero,
+// are written, each one after its index
+static void pages(Checkpoint *c, uint8_t *p, size_t len, bool delta) {
+  uint32_t nr_page = len / PAGE_SIZE, idx;
+  if (c->save) {
+    for (idx = 0; idx < nr_page; idx ++) {
+      if (delta ? !dirty_page(idx) : page_is_zero(p + idx * PAGE_SIZE)) continue;
+      ckpt_data(c, &idx, sizeof(idx));
+      ckpt_data(c, p + idx * PAGE_SIZE, PAGE_SIZE);
+    }
+    idx = CKPT_PAGE_END;
+    ckpt_data(c, &idx, sizeof(idx));
+    return;
+  }
+  if (!delta) clear_pages(p, len);
+  while (!c->error) {
+    ckpt_data(c, &idx, sizeof(idx));
+    if (idx == CKPT_PAGE_END) break;
+    if (idx >= nr_page) { c->error = true; break; }
+    IFDEF(CONFIG_PMEM_SPARSE, sparse_touch(p + idx * PAGE_SIZE, PAGE_SIZE));
+    ckpt_data(c, p + idx * PAGE_SIZE, PAGE_SIZE);
+  }
+}
+
+void ckpt_pages(Checkpoint *c, void *buf, size_t len) {
+  pages(c, buf, len, false);
+}
+
+// a tag at the beginning of each section to detect a corrupted checkpoint
+static void ckpt_tag(Checkpoint *c, const char *tag) {
+  char buf[8] = {}, expect[8] = {};
+  memcpy(expect, tag, strnlen(tag, sizeof(expect)));
+  memcpy(buf, expect, sizeof(buf));
+  ckpt_data(c, buf, sizeof(buf));
+  if (memcmp(buf, expect, sizeof(buf)) != 0) c->error = true;
+}
+
+static bool checkpoint(const char *file, bool save, bool delta) {
+#ifdef CONFIG_SMP
+  Log("checkpoints are not supported with SMP");
+  return false;
+#endif
+  if (delta && !dirty_tracking()) {
+    Log("delta checkpoints need a checkpoint saved or loaded before, with the dirty pages tracked");
+    return false;
+  }
+  FILE *fp = fopen(file, save ? "wb" : "rb");
+  if (fp == NULL) {
+    Log("Can not open '%s'", file);
+    return false;
+  }
+  Checkpoint c = { .fp = fp, .save = save, .delta = delta, .error = false };
+
+  // the header must match the configuration of this NEMU
+  char tag[8] = {};
+  memcpy(tag, delta ? "NEMUDLTA" : "NEMUCKPT", sizeof(tag));
+  ckpt_data(&c, tag, sizeof(tag));
+  if (!save) c.delta = (memcmp(tag, "NEMUDLTA", sizeof(tag)) == 0);
+  struct { uint32_t version, cpu_size; uint64_t mbase, msize; char isa[16]; } hdr = {
+    .version = CKPT_VERSION, .mbase = CONFIG_MBASE, .msize = CONFIG_MSIZE, .isa = str(__GUEST_ISA__),
+    .cpu_size = sizeof(CPU_state),
+  }, expect = hdr;
+  ckpt_data(&c, &hdr, sizeof(hdr));
+  if (c.error || (!c.delta && memcmp(tag, "NEMUCKPT", sizeof(tag)) != 0) ||
+      memcmp(&hdr, &expect, sizeof(hdr)) != 0) {
+    Log("'%s' is not a checkpoint of this NEMU", file);
+    fclose(fp);
+    return false;
+  }
+  if (c.delta) {
+    // a delta can only be applied to the machine restored from its parent
+    uint64_t parent = last_ckpt;
+    ckpt_data(&c, &parent, sizeof(parent));
+    if (c.error || parent != last_ckpt || (!save && g_nr_guest_inst != last_ckpt)) {
+      if (last_ckpt == (uint64_t)-1) Log("'%s' is a delta, but no checkpoint is loaded before", file);
+      else Log("'%s' is not the next checkpoint after the one at instructions = %" PRIu64, file, last_ckpt);
+      fclose(fp);
+      return false;
+    }
+  }
+  // the kernel can not read into the protected pages
+  if (!save) dirty_track_stop();
+
+  ckpt_tag(&c, "cpu");
+  ckpt_data(&c, &cpu, sizeof(cpu));
+  ckpt_data(&c, &g_nr_guest_inst, sizeof(g_nr_guest_inst));
+  ckpt_tag(&c, "pmem");
+  pages(&c, guest_to_host(CONFIG_MBASE), CONFIG_MSIZE, c.delta);
+#ifdef CONFIG_DEVICE
+  ckpt_tag(&c, "device");
+  device_checkpoint(&c);
+#endif
+  ckpt_tag(&c, "end");
+  fclose(fp);
+
+  if (c.error) {
+    Log("%s checkpoint '%s' failed", save ? "Saving" : "Loading", file);
+    // the machine is partially restored and can not continue
+    if (!save) nemu_state.state = NEMU_ABORT;
+    return false;
+  }
+  if (!save) {
+    // the code in the memory is replaced
+    IFDEF(CONFIG_IDCACHE, idcache_flush());
+    // and so may be the page tables
+    IFDEF(CONFIG_TLB, tlb_flush());
+    nemu_state.state = NEMU_STOP;
+  }
+  // the next delta records the pages written after this checkpoint
+  last_ckpt = g_nr_guest_inst;
+  if (track_delta) dirty_track_start();
+  Log("%s %scheckpoint '%s' at pc = " FMT_WORD ", instructions = %" PRIu64,
+      save ? "Save" : "Load", c.delta ? "delta " : "", file, cpu.pc, g_nr_guest_inst);
+  return true;
+}
+
+void checkpoint_track_delta() {
+  track_delta = true;
+}
+
+bool checkpoint_save(const char *file) {
+  return checkpoint(file, true, false);
+}
+
+bool checkpoint_save_delta(const char *file) {
+  return checkpoint(file, true, true);
+}
+
+bool checkpoint_load(const char *file) {
+  return checkpoint(file, false, false);
+}
@@ -0,0 +1,221 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // strverscmp()
+#endif
+#include <isa.h>
+#include <fork.h>
+#include <checkpoint.h>
+#include <cpu/cpu.h>
+#include <memory/paddr.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <locale.h>
+
+typedef struct {
+  bool done;            // the child finishes its run
+  int state, halt_ret;
+  uint64_t nr_inst;     // guest instructions executed by the child
+  uint64_t time;        // unit: us
+#ifdef CONFIG_INST_MIX
+  uint64_t mix[NR_INST_CLASS];
+#endif
+} ForkResult;
+
+ForkConfig fork_config = { .nr_child = 0 };
+
+extern HART_LOCAL uint64_t g_nr_guest_inst;
+IFDEF(CONFIG_INST_MIX, extern uint64_t g_inst_mix[NR_INST_CLASS]);
+void init_alarm();
+int is_exit_status_bad();
+
+static char **sample_file = NULL; // the checkpoints of the intervals
+
+static void load_input(int idx) {
+  char file[256];
+  snprintf(file, sizeof(file), fork_config.input, idx);
+  FILE *fp = fopen(file, "rb");
+  Assert(fp, "Can not open '%s'", file);
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  Assert(in_pmem(fork_config.input_addr) && in_pmem(fork_config.input_addr + size - 1),
+      "input '%s' is out of the memory", file);
+  // pmem may be protected to track the dirty pages, which the kernel can
+  // not write into, so the input is read into a buffer and copied
+  uint8_t *buf = malloc(size);
+  assert(size == 0 || buf);
+  int ret = fread(buf, size, 1, fp);
+  assert(size == 0 || ret == 1);
+  fclose(fp);
+  memcpy(guest_to_host(fork_config.input_addr), buf, size);
+  free(buf);
+}
+
+static void __attribute__((noreturn)) child(int idx, ForkResult *res) {
+  // interval timers are not inherited by the child
+#if defined(CONFIG_DEVICE) && !defined(CONFIG_DEVICE_EVENT)
+  init_alarm();
+#endif
+  uint64_t n = -1;
+  if (sample_file != NULL) {
+    // a sampled interval runs from its checkpoint for the given number of instructions
+    if (!checkpoint_load(sample_file[idx])) exit(1);
+    n = fork_config.sample_inst;
+  } else if (fork_config.input != NULL) {
+    load_input(idx);
+  }
+  IFDEF(CONFIG_INST_MIX, memset(g_inst_mix, 0, sizeof(g_inst_mix)));
+
+  uint64_t nr_inst = g_nr_guest_inst, start = get_time();
+  cpu_exec(n);
+  res->nr_inst = g_nr_guest_inst - nr_inst;
+  res->time = get_time() - start;
+  res->state = nemu_state.state;
+  res->halt_ret = nemu_state.halt_ret;
+  IFDEF(CONFIG_INST_MIX, memcpy(res->mix, g_inst_mix, sizeof(g_inst_mix)));
+  res->done = true;
+  // reaching the end of the interval is also good
+  exit(nemu_state.state == NEMU_STOP ? 0 : is_exit_status_bad());
+}
+
+static void report(int idx, pid_t pid, int status, ForkResult *res) {
+  char name[64];
+  if (sample_file != NULL) snprintf(name, sizeof(name), "%s", sample_file[idx]);
+  else snprintf(name, sizeof(name), "child %d", idx);
+  if (WIFSIGNALED(status)) {
+    Log("%s (pid %d) is killed by signal %d", name, pid, WTERMSIG(status));
+  } else if (!res->done) {
+    Log("%s (pid %d) exits with %d", name, pid, WEXITSTATUS(status));
+  } else {
+    Log("%s (pid %d) exits with %d, %s, halt_ret = %d, instructions = %" PRIu64 ", time = %" PRIu64 " us",
+        name, pid, WEXITSTATUS(status),
+        res->state == NEMU_ABORT ? "ABORT" : (res->state == NEMU_END ? "END" : "STOP"),
+        res->halt_ret, res->nr_inst, res->time);
+  }
+}
+
+// run `n' children, at most `fork_config.nr_job' at the same time, then
+// report the merged statistics
+static void pool_run(int n) {
+  int nr_job = (fork_config.nr_job > 0 ? fork_config.nr_job : sysconf(_SC_NPROCESSORS_ONLN));
+  // the results are written by the children to the shared memory
+  ForkResult *res = mmap(NULL, sizeof(ForkResult) * n, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  Assert(res != MAP_FAILED, "Can not allocate the results of children");
+  pid_t *pid = calloc(n, sizeof(pid_t));
+  assert(pid);
+
+  uint64_t start = get_time(), nr_inst = 0, time = 0;
+  IFDEF(CONFIG_INST_MIX, uint64_t mix[NR_INST_CLASS] = {});
+  int nr_run = 0, nr_bad = 0;
+  for (int next = 0, nr_exit = 0; nr_exit < n; ) {
+    while (next < n && nr_run < nr_job) {
+      fflush(NULL);
+      pid_t p = fork();
+      Assert(p >= 0, "Can not fork child %d", next);
+      if (p == 0) child(next, &res[next]);
+      pid[next ++] = p;
+      nr_run ++;
+    }
+    int status;
+    pid_t p = wait(&status);
+    Assert(p > 0, "wait() fails");
+    int idx = 0;
+    while (idx < next && pid[idx] != p) idx ++;
+    if (idx == next) continue; // not a child of the pool
+    report(idx, p, status, &res[idx]);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) nr_bad ++;
+    nr_inst += res[idx].nr_inst;
+    time += res[idx].time;
+#ifdef CONFIG_INST_MIX
+    for (int i = 0; i < NR_INST_CLASS; i ++) mix[i] += res[idx].mix[i];
+#endif
+    nr_run --;
+    nr_exit ++;
+  }
+
+  setlocale(LC_NUMERIC, "");
+  Log("children = %d, bad = %d, jobs = %d", n, nr_bad, nr_job);
+  Log("host time spent = " NUMBERIC_FMT " us, by all children = " NUMBERIC_FMT " us", get_time() - start, time);
+  Log("total guest instructions of children = " NUMBERIC_FMT, nr_inst);
+  if (time > 0) Log("simulation frequency of children = " NUMBERIC_FMT " inst/s", nr_inst * 1000000 / time);
+#ifdef CONFIG_INST_MIX
+  for (int i = 0; i < NR_INST_CLASS; i ++) {
+    Log("instruction mix %-7s = " NUMBERIC_FMT " (%.2f%%)", isa_inst_class_name[i], mix[i],
+        nr_inst > 0 ? mix[i] * 100.0 / nr_inst : 0.0);
+  }
+#endif
+
+  free(pid);
+  munmap(res, sizeof(ForkResult) * n);
+  // the exit status of NEMU reports whether all children are good
+  nemu_state.state = NEMU_END;
+  nemu_state.halt_ret = nr_bad;
+}
+
+void fork_run() {
+#ifdef CONFIG_SMP
+  Log("fork is not supported with SMP");
+  nemu_state.state = NEMU_ABORT;
+  return;
+#endif
+  if (fork_config.use_pc) cpu_exec_until(fork_config.pc, -1);
+  else if (fork_config.at_inst > 0) cpu_exec(fork_config.at_inst);
+  if (nemu_state.state != NEMU_STOP) {
+    Log("the program ends before the fork point");
+    return;
+  }
+  Log("fork %d children at pc = " FMT_WORD ", instructions = %" PRIu64,
+      fork_config.nr_child, cpu.pc, g_nr_guest_inst);
+  pool_run(fork_config.nr_child);
+}
+
+static int cmp_name(const void *a, const void *b) {
+  return strverscmp(*(char **)a, *(char **)b);
+}
+
+void sample_run() {
+#ifdef CONFIG_SMP
+  Log("sampled simulation is not supported with SMP");
+  nemu_state.state = NEMU_ABORT;
+  return;
+#endif
+  DIR *dir = opendir(fork_config.sample_dir);
+  Assert(dir, "Can not open directory '%s'", fork_config.sample_dir);
+  int n = 0;
+  struct dirent *d;
+  while ((d = readdir(dir)) != NULL) {
+    if (d->d_name[0] == '.') continue;
+    sample_file = realloc(sample_file, sizeof(char *) * (n + 1));
+    assert(sample_file);
+    sample_file[n] = malloc(strlen(fork_config.sample_dir) + strlen(d->d_name) + 2);
+    assert(sample_file[n]);
+    sprintf(sample_file[n ++], "%s/%s", fork_config.sample_dir, d->d_name);
+  }
+  closedir(dir);
+  if (n == 0) {
+    Log("no checkpoint in '%s'", fork_config.sample_dir);
+    return;
+  }
+  // the checkpoints of simpoints are named CKPT.<interval>
+  qsort(sample_file, n, sizeof(char *), cmp_name);
+  Log("run %d intervals from the checkpoints in '%s', %" PRIu64 " instructions each",
+      n, fork_config.sample_dir, fork_config.sample_inst);
+  pool_run(n);
+}
@@ -15,6 +15,13 @@
 
 #include <isa.h>
 #include <memory/paddr.h>
+#include <memory/sparse.h>
+#include <checkpoint.h>
+#include <fork.h>
+#include <cpu/bbv.h>
+#include <cpu/profile.h>
+#include <cpu/inst-count.h>
+#include <cpu/btrace.h>
 
 void init_rand();
 void init_log(const char *log_file);
@@ -40,11 +47,27 @@ static void welcome() {
 #include <getopt.h>
 
 void sdb_set_batch_mode();
+void sdb_set_checkpoint(char *file, uint64_t n, uint64_t every);
+void sdb_set_simpoints(char *file, uint64_t interval);
 
 static char *log_file = NULL;
 static char *diff_so_file = NULL;
 static char *img_file = NULL;
 static int difftest_port = 1234;
+#define MAX_CKPT_CHAIN 64
+static char *ckpt_load_file[MAX_CKPT_CHAIN] = {};
+static int nr_ckpt_load = 0;
+static char *ckpt_save_file = NULL;
+static uint64_t ckpt_save_at = 0;
+static uint64_t ckpt_save_every = 0;
+static char *bbv_file = NULL;
+static char *simpoints_file = NULL;
+static uint64_t bbv_interval = 10000000;
+static char *profile_prefix = NULL;
+static uint64_t profile_interval = 10000;
+static int profile_hz = 0;
+static char *inst_count_prefix = NULL;
+static char *btrace_file = NULL;
 
 static long load_img() {
   if (img_file == NULL) {
@@ -61,6 +84,7 @@ static long load_img() {
   Log("The image is %s, size = %ld", img_file, size);
 
   fseek(fp, 0, SEEK_SET);
+  IFDEF(CONFIG_PMEM_SPARSE, sparse_touch(guest_to_host(RESET_VECTOR), size));
   int ret = fread(guest_to_host(RESET_VECTOR), size, 1, fp);
   assert(ret == 1);
 
@@ -74,18 +98,61 @@ static int parse_args(int argc, char *argv[]) {
     {"log"      , required_argument, NULL, 'l'},
     {"diff"     , required_argument, NULL, 'd'},
     {"port"     , required_argument, NULL, 'p'},
+    {"restore"  , required_argument, NULL, 'r'},
+    {"save"     , required_argument, NULL, 's'},
+    {"save-at"  , required_argument, NULL, 'S'},
+    {"save-every", required_argument, NULL, 'E'},
+    {"bbv"      , required_argument, NULL, 'B'},
+    {"bbv-interval", required_argument, NULL, 'N'},
+    {"simpoints", required_argument, NULL, 'M'},
+    {"profile"  , required_argument, NULL, 'O'},
+    {"profile-interval", required_argument, NULL, 'i'},
+    {"profile-hz", required_argument, NULL, 'z'},
+    {"inst-count", required_argument, NULL, 'C'},
+    {"btrace"   , required_argument, NULL, 't'},
+    {"sample"   , required_argument, NULL, 'R'},
+    {"sample-inst", required_argument, NULL, 'L'},
+    {"fork"     , required_argument, NULL, 'f'},
+    {"fork-jobs", required_argument, NULL, 'j'},
+    {"fork-at"  , required_argument, NULL, 'A'},
+    {"fork-pc"  , required_argument, NULL, 'P'},
+    {"fork-input", required_argument, NULL, 'I'},
+    {"fork-input-addr", required_argument, NULL, 'a'},
     {"help"     , no_argument      , NULL, 'h'},
     {0          , 0                , NULL,  0 },
   };
   int o;
   // 选项后带一个冒号，表示后面带一个参数，如-d 100
   // 选项后带两个冒号，表示后面可带或不带参数，如果带参数，则选项与参数直接不能有空格，如-b200
-  while ( (o = getopt_long(argc, argv, "-bhl:d:p:", table, NULL)) != -1) {
+  while ( (o = getopt_long(argc, argv, "-bhl:d:p:r:s:S:E:B:N:M:R:L:O:i:z:C:t:f:j:A:P:I:a:", table, NULL)) != -1) {
     switch (o) {
       case 'b': sdb_set_batch_mode(); break;
       case 'p': sscanf(optarg, "%d", &difftest_port); break;
       case 'l': log_file = optarg; break; // optarg会自动赋值为命令行传入的值，如-l 1.txt的1.txt
       case 'd': diff_so_file = optarg; break;
+      case 'r':
+        Assert(nr_ckpt_load < MAX_CKPT_CHAIN, "Too many checkpoints to restore");
+        ckpt_load_file[nr_ckpt_load ++] = optarg;
+        break;
+      case 's': ckpt_save_file = optarg; break;
+      case 'S': sscanf(optarg, "%" SCNu64, &ckpt_save_at); break;
+      case 'E': sscanf(optarg, "%" SCNu64, &ckpt_save_every); break;
+      case 'B': bbv_file = optarg; break;
+      case 'N': sscanf(optarg, "%" SCNu64, &bbv_interval); break;
+      case 'M': simpoints_file = optarg; break;
+      case 'O': profile_prefix = optarg; break;
+      case 'i': sscanf(optarg, "%" SCNu64, &profile_interval); break;
+      case 'z': sscanf(optarg, "%d", &profile_hz); break;
+      case 'C': inst_count_prefix = optarg; break;
+      case 't': btrace_file = optarg; break;
+      case 'R': fork_config.sample_dir = optarg; break;
+      case 'L': sscanf(optarg, "%" SCNu64, &fork_config.sample_inst); break;
+      case 'f': sscanf(optarg, "%d", &fork_config.nr_child); break;
+      case 'j': sscanf(optarg, "%d", &fork_config.nr_job); break;
+      case 'A': sscanf(optarg, "%" SCNu64, &fork_config.at_inst); break;
+      case 'P': fork_config.pc = strtoul(optarg, NULL, 0); fork_config.use_pc = true; break;
+      case 'I': fork_config.input = optarg; break;
+      case 'a': fork_config.input_addr = strtoul(optarg, NULL, 0); break;
       case 1: img_file = optarg; return 0; // ??? 什么情况会返回o是1?
       default:
         printf("Usage: %s [OPTION...] IMAGE [args]\n\n", argv[0]);
@@ -93,6 +160,28 @@ static int parse_args(int argc, char *argv[]) {
         printf("\t-l,--log=FILE           output log to FILE\n");
         printf("\t-d,--diff=REF_SO        run DiffTest with reference REF_SO\n");
         printf("\t-p,--port=PORT          run DiffTest with port PORT\n");
+        printf("\t-r,--restore=CKPT       restore the checkpoint CKPT after loading the image,\n");
+        printf("\t                        repeat it to restore a chain of delta checkpoints\n");
+        printf("\t-s,--save=CKPT          save a checkpoint to CKPT, see --save-at\n");
+        printf("\t-S,--save-at=N          run N instructions before saving the checkpoint\n");
+        printf("\t-E,--save-every=N       then save a delta checkpoint CKPT.1, CKPT.2, ... every N instructions\n");
+        printf("\t-B,--bbv=FILE           write basic-block vectors to FILE (needs CONFIG_BBV)\n");
+        printf("\t-N,--bbv-interval=N     the interval of basic-block vectors, default 10000000\n");
+        printf("\t-M,--simpoints=FILE     save checkpoints CKPT.<interval> of the simpoints in FILE\n");
+        printf("\t-O,--profile=PREFIX     write the guest profile to PREFIX.flat and PREFIX.folded (needs CONFIG_PROFILE)\n");
+        printf("\t-i,--profile-interval=N sample the pc every N instructions, default 10000\n");
+        printf("\t-z,--profile-hz=HZ      sample the pc HZ times per second of host time instead\n");
+        printf("\t-C,--inst-count=PREFIX  write the executions of each instruction to PREFIX.csv and PREFIX.json\n");
+        printf("\t                        (needs CONFIG_INST_COUNT)\n");
+        printf("\t-t,--btrace=FILE        write a binary instruction trace to FILE (needs CONFIG_BTRACE)\n");
+        printf("\t-R,--sample=DIR         run each checkpoint in DIR as an interval in a child, see --fork-jobs\n");
+        printf("\t-L,--sample-inst=N      the number of instructions of each interval, default --bbv-interval\n");
+        printf("\t-f,--fork=N             fork N children at the fork point, each runs to the end\n");
+        printf("\t-j,--fork-jobs=N        run at most N children at the same time\n");
+        printf("\t-A,--fork-at=N          the fork point is after N instructions\n");
+        printf("\t-P,--fork-pc=PC         the fork point is when the pc reaches PC\n");
+        printf("\t-I,--fork-input=FILE    each child loads FILE, %%d in FILE is the index of the child\n");
+        printf("\t-a,--fork-input-addr=PA the address where the children load their input\n");
         printf("\n");
         exit(0);
     }
@@ -130,19 +219,44 @@ void init_monitor(int argc, char *argv[]) {
   /* Initialize the simple debugger. */
   init_sdb();
 
-#ifndef CONFIG_ISA_loongarch32r
-  IFDEF(CONFIG_ITRACE, init_disasm(
+#if !defined(CONFIG_ISA_loongarch32r) && (defined(CONFIG_ITRACE) || defined(CONFIG_IQUEUE))
+  init_disasm(
     MUXDEF(CONFIG_ISA_x86,     "i686",
     MUXDEF(CONFIG_ISA_mips32,  "mipsel",
     MUXDEF(CONFIG_ISA_riscv,
       MUXDEF(CONFIG_RV64,      "riscv64",
                                "riscv32"),
                                "bad"))) "-pc-linux-gnu"
-  ));
+  );
 #endif
 
   /* Display welcome message. */
   welcome();
+
+  /* Restore the checkpoint, the one to save is taken by sdb after the engine starts. */
+  for (int i = 0; i < nr_ckpt_load; i ++) {
+    Assert(checkpoint_load(ckpt_load_file[i]), "Can not restore checkpoint '%s'", ckpt_load_file[i]);
+  }
+  if (ckpt_save_file != NULL) sdb_set_checkpoint(ckpt_save_file, ckpt_save_at, ckpt_save_every);
+  Assert(simpoints_file == NULL || ckpt_save_file != NULL, "--simpoints needs --save for the checkpoints");
+  if (fork_config.sample_inst == 0) fork_config.sample_inst = bbv_interval;
+  if (simpoints_file != NULL) sdb_set_simpoints(simpoints_file, bbv_interval);
+  if (profile_prefix != NULL) {
+    IFDEF(CONFIG_PROFILE, init_profile(img_file, profile_prefix, profile_interval, profile_hz));
+    IFNDEF(CONFIG_PROFILE, panic("The profiler needs CONFIG_PROFILE"));
+  }
+  if (inst_count_prefix != NULL) {
+    IFDEF(CONFIG_INST_COUNT, inst_count_set_output(inst_count_prefix));
+    IFNDEF(CONFIG_INST_COUNT, panic("Instruction counts need CONFIG_INST_COUNT"));
+  }
+  if (btrace_file != NULL) {
+    IFDEF(CONFIG_BTRACE, init_btrace(btrace_file));
+    IFNDEF(CONFIG_BTRACE, panic("The binary trace needs CONFIG_BTRACE"));
+  }
+  if (bbv_file != NULL) {
+    IFDEF(CONFIG_BBV, init_bbv(bbv_file, bbv_interval));
+    IFNDEF(CONFIG_BBV, panic("Basic-block vectors need CONFIG_BBV"));
+  }
 }
 #else // CONFIG_TARGET_AM
 static long load_img() {
@@ -18,9 +18,19 @@
 #include <readline/readline.h>
 #include <readline/history.h>
 #include <memory/paddr.h>
+#include <checkpoint.h>
+#include <fork.h>
 #include "sdb.h"
 
 static int is_batch_mode = false;
+static char *ckpt_file = NULL;
+static uint64_t ckpt_at = 0;
+static uint64_t ckpt_every = 0;
+static uint64_t *simpoint = NULL; // the intervals chosen by tools/simpoint
+static int nr_simpoint = 0;
+static uint64_t simpoint_interval = 0;
+
+extern HART_LOCAL uint64_t g_nr_guest_inst;
 
 void init_regex();
 void init_wp_pool();
@@ -102,7 +112,7 @@ static int cmd_x(char *args) {
 
   uint8_t* mem = guest_to_host(addr);
 
-  printf("0x%8x: ", addr);
+  printf(FMT_PADDR ": ", addr);
   for (int i = 0; i < num; i++) {
     printf("0x");
     for (int j = 3; j >= 0; j--){
@@ -172,6 +182,28 @@ static int cmd_d(char *args) {
 
 static int cmd_help(char *args);
 
+static int cmd_save(char *args) {
+  if (args == NULL) {
+    Log_error("args is NULL, please enter save [-d] FILE\n");
+    return 0;
+  }
+  // the next checkpoint may be a delta
+  checkpoint_track_delta();
+  if (strncmp(args, "-d ", 3) == 0) checkpoint_save_delta(args + 3);
+  else checkpoint_save(args);
+  return 0;
+}
+
+static int cmd_load(char *args) {
+  if (args == NULL) {
+    Log_error("args is NULL, please enter load FILE\n");
+    return 0;
+  }
+  checkpoint_track_delta();
+  checkpoint_load(args);
+  return 0;
+}
+
 static struct {
   const char *name;
   const char *description;
@@ -186,6 +218,8 @@ static struct {
   { "p", "expression evaluation", cmd_p },
   { "w", "set watchpoint", cmd_w },
   { "d", "delete watchpoint", cmd_d },
+  { "save", "Save a checkpoint of the machine to a file, -d for a delta checkpoint", cmd_save },
+  { "load", "Restore the machine from a checkpoint file", cmd_load },
 };
 
 #define NR_CMD ARRLEN(cmd_table)
@@ -217,7 +251,69 @@ void sdb_set_batch_mode() {
   is_batch_mode = true;
 }
 
+void sdb_set_checkpoint(char *file, uint64_t n, uint64_t every) {
+  ckpt_file = file;
+  ckpt_at = n;
+  ckpt_every = every;
+  if (every > 0) checkpoint_track_delta();
+}
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(uint64_t *)a, y = *(uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+// the file written by tools/simpoint has a line "interval cluster" for each simpoint
+void sdb_set_simpoints(char *file, uint64_t interval) {
+  FILE *fp = fopen(file, "r");
+  Assert(fp, "Can not open '%s'", file);
+  uint64_t idx;
+  int cluster;
+  while (fscanf(fp, "%" SCNu64 " %d", &idx, &cluster) == 2) {
+    simpoint = realloc(simpoint, sizeof(uint64_t) * (nr_simpoint + 1));
+    assert(simpoint);
+    simpoint[nr_simpoint ++] = idx;
+  }
+  fclose(fp);
+  qsort(simpoint, nr_simpoint, sizeof(uint64_t), cmp_u64);
+  simpoint_interval = interval;
+}
+
+// save a checkpoint at the beginning of each simpoint
+static void save_simpoints() {
+  for (int i = 0; i < nr_simpoint; i ++) {
+    uint64_t start = simpoint[i] * simpoint_interval;
+    if (start > g_nr_guest_inst) cpu_exec(start - g_nr_guest_inst);
+    if (nemu_state.state != NEMU_STOP && nemu_state.state != NEMU_RUNNING) break;
+    char file[256];
+    snprintf(file, sizeof(file), "%s.%" PRIu64, ckpt_file, simpoint[i]);
+    Assert(checkpoint_save(file), "Can not save checkpoint '%s'", file);
+  }
+}
+
 void sdb_mainloop() {
+  if (ckpt_file != NULL && nr_simpoint > 0) save_simpoints();
+  else if (ckpt_file != NULL) {
+    if (ckpt_at > 0) cpu_exec(ckpt_at);
+    Assert(checkpoint_save(ckpt_file), "Can not save checkpoint '%s'", ckpt_file);
+    for (int i = 1; ckpt_every > 0; i ++) {
+      cpu_exec(ckpt_every);
+      if (nemu_state.state != NEMU_STOP) break;
+      char file[256];
+      snprintf(file, sizeof(file), "%s.%d", ckpt_file, i);
+      Assert(checkpoint_save_delta(file), "Can not save checkpoint '%s'", file);
+    }
+  }
+
+  if (fork_config.sample_dir != NULL) {
+    sample_run();
+    return;
+  }
+  if (fork_config.nr_child > 0) {
+    fork_run();
+    return;
+  }
+
   if (is_batch_mode) {
     cmd_c(NULL);
     return;
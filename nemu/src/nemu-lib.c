@@ -0,0 +1,165 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <isa.h>
+#include <cpu/cpu.h>
+#include <cpu/idcache.h>
+#include <memory/paddr.h>
+#include <libnemu.h>
+#include <pthread.h>
+
+// The state of a machine is copied to the thread-local variables of the
+// simulator when it runs, and copied back when it stops.
+struct Nemu {
+  CPU_state cpu;
+  NEMUState state;
+  uint64_t nr_inst;
+  uint8_t *pmem;
+  FILE *serial;
+  uint64_t epoch; // changed whenever the memory is written outside this thread
+};
+
+void init_rand();
+void init_log(const char *log_file);
+void init_device();
+void set_pmem(uint8_t *p);
+extern HART_LOCAL uint64_t g_nr_guest_inst;
+#ifdef CONFIG_HAS_SERIAL
+extern MACHINE_LOCAL FILE *serial_fp;
+#endif
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t init_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t g_epoch = 0;
+static MACHINE_LOCAL bool thread_ready = false;
+static MACHINE_LOCAL Nemu *last = NULL; // the machine last run by this thread
+static MACHINE_LOCAL uint64_t last_epoch = 0;
+
+static void touch(Nemu *m) {
+  m->epoch = __atomic_add_fetch(&g_epoch, 1, __ATOMIC_RELAXED);
+}
+
+static void bind(Nemu *m) {
+  if (!thread_ready) {
+    // the devices of the library keep no state, so each thread only sets them up once
+    IFDEF(CONFIG_DEVICE, init_device());
+    thread_ready = true;
+  }
+  if (last != m || last_epoch != m->epoch) {
+    // the decode cache only holds the code of the last machine run by this thread
+    IFDEF(CONFIG_IDCACHE, idcache_flush());
+    last = m;
+  }
+  cpu = m->cpu;
+  nemu_state = m->state;
+  g_nr_guest_inst = m->nr_inst;
+  set_pmem(m->pmem);
+  IFDEF(CONFIG_HAS_SERIAL, serial_fp = m->serial);
+}
+
+static void unbind(Nemu *m) {
+  m->cpu = cpu;
+  m->state = nemu_state;
+  m->nr_inst = g_nr_guest_inst;
+  touch(m);
+  last_epoch = m->epoch;
+}
+
+static Nemu* new_machine() {
+  Nemu *m = calloc(1, sizeof(Nemu));
+  assert(m);
+  m->pmem = malloc(CONFIG_MSIZE);
+  assert(m->pmem);
+  IFDEF(CONFIG_MEM_RANDOM, memset(m->pmem, rand(), CONFIG_MSIZE));
+  m->state.state = NEMU_STOP;
+  m->serial = stderr;
+  bind(m);
+  // init_isa() builds the decode tables shared by all threads on its first call
+  pthread_mutex_lock(&init_lock);
+  init_isa();
+  pthread_mutex_unlock(&init_lock);
+  unbind(m);
+  return m;
+}
+
+static void init_lib() {
+  init_rand();
+  init_log(NULL);
+}
+
+Nemu* nemu_create() {
+  pthread_once(&once, init_lib);
+  return new_machine();
+}
+
+void nemu_destroy(Nemu *m) {
+  if (last == m) last = NULL;
+  free(m->pmem);
+  free(m);
+}
+
+bool nemu_load(Nemu *m, const char *img_file) {
+  FILE *fp = fopen(img_file, "rb");
+  if (fp == NULL) return false;
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  bool ok = (size <= CONFIG_MSIZE - CONFIG_PC_RESET_OFFSET) &&
+    fread(m->pmem + RESET_VECTOR - CONFIG_MBASE, size, 1, fp) == 1;
+  fclose(fp);
+  touch(m);
+  return ok;
+}
+
+void nemu_memcpy(Nemu *m, uint64_t paddr, void *buf, size_t n, bool to_guest) {
+  Assert(paddr >= CONFIG_MBASE && paddr + n <= (uint64_t)CONFIG_MBASE + CONFIG_MSIZE,
+      "[%#" PRIx64 ", %#" PRIx64 ") is out of bound of pmem", paddr, paddr + n);
+  uint8_t *p = m->pmem + paddr - CONFIG_MBASE;
+  if (to_guest) { memcpy(p, buf, n); touch(m); }
+  else memcpy(buf, p, n);
+}
+
+void nemu_set_serial(Nemu *m, FILE *fp) {
+  m->serial = fp;
+}
+
+uint64_t nemu_run(Nemu *m, uint64_t n) {
+  bind(m);
+  uint64_t start = g_nr_guest_inst;
+  cpu_exec(n);
+  uint64_t nr = g_nr_guest_inst - start;
+  unbind(m);
+  return nr;
+}
+
+bool nemu_halted(Nemu *m, int *code) {
+  switch (m->state.state) {
+    case NEMU_END: if (code) *code = m->state.halt_ret; return true;
+    case NEMU_ABORT: case NEMU_QUIT: if (code) *code = -1; return true;
+    default: return false;
+  }
+}
+
+uint64_t nemu_reg(Nemu *m, const char *name, bool *success) {
+  CPU_state saved = cpu;
+  cpu = m->cpu;
+  uint64_t val = isa_reg_str2val(name, success);
+  cpu = saved;
+  return val;
+}
+
+uint64_t nemu_nr_inst(Nemu *m) {
+  return m->nr_inst;
+}
@@ -0,0 +1,342 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+// Translate the code of a riscv32 ELF into C functions which run on
+// NEMU's CPU_state and memory. The output is built into NEMU with
+// ENGINE_AOT, see src/engine/aot/aot.c.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <elf.h>
+
+#define BITS(x, hi, lo) (((x) >> (lo)) & ((1ull << ((hi) - (lo) + 1)) - 1))
+#define SEXT(x, len) ((int32_t)((uint32_t)(x) << (32 - (len))) >> (32 - (len)))
+
+// at most this number of instructions are executed between two budget checks,
+// this should match AOT_CHECK_INTERVAL in NEMU
+#define CHECK_INTERVAL 32
+
+typedef struct {
+  uint32_t start, end;
+  const char *name;
+} Func;
+
+static uint8_t *elf = NULL;
+static FILE *out = NULL;
+
+static Func *func = NULL;
+static int nr_func = 0;
+
+static uint8_t *text = NULL; // the executable section being translated
+static uint32_t text_start = 0, text_end = 0;
+
+static uint32_t fetch(uint32_t pc) {
+  uint32_t inst;
+  memcpy(&inst, text + (pc - text_start), 4);
+  return inst;
+}
+
+static uint32_t hash(uint32_t start, uint32_t end) {
+  uint32_t h = 2166136261u;
+  for (uint32_t pc = start; pc < end; pc += 4) {
+    h = (h ^ fetch(pc)) * 16777619u;
+  }
+  return h;
+}
+
+static int cmp_addr(const void *a, const void *b) {
+  uint32_t x = ((const Func *)a)->start, y = ((const Func *)b)->start;
+  return (x > y) - (x < y);
+}
+
+static void add_func(uint32_t start, const char *name) {
+  func = realloc(func, sizeof(Func) * (nr_func + 1));
+  assert(func);
+  func[nr_func ++] = (Func) { .start = start, .name = name };
+}
+
+// split the executable section by the function symbols inside it
+static void collect_func(Elf32_Ehdr *eh, Elf32_Shdr *text_sh) {
+  Elf32_Shdr *sh = (Elf32_Shdr *)(elf + eh->e_shoff);
+  int first = nr_func;
+  add_func(text_start, NULL);
+  for (int i = 0; i < eh->e_shnum; i ++) {
+    if (sh[i].sh_type != SHT_SYMTAB) continue;
+    Elf32_Sym *sym = (Elf32_Sym *)(elf + sh[i].sh_offset);
+    const char *strtab = (const char *)(elf + sh[sh[i].sh_link].sh_offset);
+    int nr_sym = sh[i].sh_size / sizeof(Elf32_Sym);
+    for (int j = 0; j < nr_sym; j ++) {
+      if (ELF32_ST_TYPE(sym[j].st_info) != STT_FUNC) continue;
+      uint32_t addr = sym[j].st_value;
+      if (addr < text_start || addr >= text_end || (addr & 0x3)) continue;
+      add_func(addr, strtab + sym[j].st_name);
+    }
+  }
+  qsort(func + first, nr_func - first, sizeof(Func), cmp_addr);
+
+  // remove duplicated boundaries, keep the named one
+  int n = first;
+  for (int i = first; i < nr_func; i ++) {
+    if (n > first && func[n - 1].start == func[i].start) {
+      if (func[n - 1].name == NULL) func[n - 1].name = func[i].name;
+      continue;
+    }
+    func[n ++] = func[i];
+  }
+  nr_func = n;
+  for (int i = first; i < nr_func; i ++) {
+    func[i].end = (i + 1 < nr_func ? func[i + 1].start : text_end);
+  }
+}
+
+// --- translation ---
+
+static Func *cur = NULL;
+
+static bool in_func(uint32_t pc) { return pc >= cur->start && pc < cur->end; }
+
+// the code of the instruction being translated
+static char code[1024];
+static int code_len = 0;
+
+__attribute__((format(printf, 1, 2)))
+static void emit(const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  code_len += vsnprintf(code + code_len, sizeof(code) - code_len, fmt, ap);
+  va_end(ap);
+  assert(code_len < sizeof(code));
+}
+
+static void emit_exit(uint32_t target) {
+  emit("cpu.pc = 0x%08x; return cnt;", target);
+}
+
+static void emit_jump(uint32_t target) {
+  if (in_func(target)) {
+    emit("if (cnt >= budget) { cpu.pc = 0x%08x; return cnt; } goto L_%08x;", target, target);
+  } else {
+    emit_exit(target);
+  }
+}
+
+static void emit_wreg(int rd, const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  if (rd != 0) emit("R(%d) = ", rd);
+  code_len += vsnprintf(code + code_len, sizeof(code) - code_len, fmt, ap);
+  emit(";");
+  va_end(ap);
+}
+
+// return false if the instruction is not translated, and should be executed by NEMU
+static bool translate(uint32_t pc, uint32_t i, bool *end_of_block) {
+  int rd = BITS(i, 11, 7), rs1 = BITS(i, 19, 15), rs2 = BITS(i, 24, 20);
+  uint32_t opc = BITS(i, 6, 0), f3 = BITS(i, 14, 12), f7 = BITS(i, 31, 25);
+  int32_t immI = SEXT(BITS(i, 31, 20), 12);
+  int32_t immS = SEXT((BITS(i, 31, 25) << 5) | BITS(i, 11, 7), 12);
+  int32_t immB = SEXT((BITS(i, 11, 8) << 1) | (BITS(i, 30, 25) << 5) | (BITS(i, 7, 7) << 11) | (BITS(i, 31, 31) << 12), 13);
+  int32_t immJ = SEXT((BITS(i, 30, 21) << 1) | (BITS(i, 20, 20) << 11) | (BITS(i, 19, 12) << 12) | (BITS(i, 31, 31) << 20), 21);
+  uint32_t immU = i & 0xfffff000u;
+  *end_of_block = false;
+
+  switch (opc) {
+    case 0x37: if (rd) emit_wreg(rd, "0x%08x", immU); return true;
+    case 0x17: if (rd) emit_wreg(rd, "0x%08x", pc + immU); return true;
+    case 0x6f:
+      if (rd) emit_wreg(rd, "0x%08x", pc + 4);
+      emit_jump(pc + immJ);
+      *end_of_block = true;
+      return true;
+    case 0x67:
+      if (f3 != 0) return false;
+      emit("{ word_t t = (R(%d) + %d) & ~1u; ", rs1, immI);
+      if (rd) emit_wreg(rd, "0x%08x", pc + 4);
+      emit(" cpu.pc = t; return cnt; }");
+      *end_of_block = true;
+      return true;
+    case 0x63: {
+      static const char *cond[] = { "R(%d) == R(%d)", "R(%d) != R(%d)", NULL, NULL,
+        "(sword_t)R(%d) < (sword_t)R(%d)", "(sword_t)R(%d) >= (sword_t)R(%d)",
+        "R(%d) < R(%d)", "R(%d) >= R(%d)" };
+      if (cond[f3] == NULL) return false;
+      emit("if (");
+      emit(cond[f3], rs1, rs2);
+      emit(") { ");
+      emit_jump(pc + immB);
+      emit(" }");
+      return true;
+    }
+    case 0x03: {
+      static const char *fmt[] = { "SEXT(vaddr_read8(R(%d) + %d), 8)", "SEXT(vaddr_read16(R(%d) + %d), 16)",
+        "vaddr_read32(R(%d) + %d)", NULL, "vaddr_read8(R(%d) + %d)", "vaddr_read16(R(%d) + %d)" };
+      if (f3 > 5 || fmt[f3] == NULL) return false;
+      emit_wreg(rd, fmt[f3], rs1, immI);
+      return true;
+    }
+    case 0x23:
+      if (f3 > 2) return false;
+      emit("vaddr_write%d(R(%d) + %d, R(%d));", 8 << f3, rs1, immS, rs2);
+      return true;
+    case 0x13: {
+      const char *fmt = NULL;
+      switch (f3) {
+        case 0: fmt = "R(%d) + %d"; break;
+        case 2: fmt = "(sword_t)R(%d) < (sword_t)%d"; break;
+        case 3: fmt = "R(%d) < (word_t)%d"; break;
+        case 4: fmt = "R(%d) ^ %d"; break;
+        case 6: fmt = "R(%d) | %d"; break;
+        case 7: fmt = "R(%d) & %d"; break;
+        case 1: if (f7 != 0) return false; fmt = "R(%d) << %d"; break;
+        case 5:
+          if (f7 == 0) fmt = "R(%d) >> %d";
+          else if (f7 == 0x20) fmt = "(word_t)((sword_t)R(%d) >> %d)";
+          else return false;
+          break;
+      }
+      if (rd) emit_wreg(rd, fmt, rs1, (f3 == 1 || f3 == 5) ? (immI & 0x1f) : immI);
+      return true;
+    }
+    case 0x33: {
+      static const char *base[] = { "R(%d) + R(%d)", "R(%d) << (R(%d) & 0x1f)",
+        "(sword_t)R(%d) < (sword_t)R(%d)", "R(%d) < R(%d)", "R(%d) ^ R(%d)",
+        "R(%d) >> (R(%d) & 0x1f)", "R(%d) | R(%d)", "R(%d) & R(%d)" };
+      // the same expressions as the INSTPAT table of NEMU
+      static const char *m[] = { "R(%d) * R(%d)",
+        "((long)(sword_t)R(%d) * (long)(sword_t)R(%d)) >> 32",
+        "((long)(sword_t)R(%d) * (unsigned long)R(%d)) >> 32",
+        "((unsigned long)R(%d) * (unsigned long)R(%d)) >> 32",
+        "(sword_t)R(%d) / (sword_t)R(%d)", "(sword_t)R(%d) / R(%d)",
+        "(sword_t)R(%d) % (sword_t)R(%d)", "(sword_t)R(%d) % R(%d)" };
+      const char *fmt = NULL;
+      if (f7 == 0) fmt = base[f3];
+      else if (f7 == 1) fmt = m[f3];
+      else if (f7 == 0x20 && f3 == 0) fmt = "R(%d) - R(%d)";
+      else if (f7 == 0x20 && f3 == 5) fmt = "(word_t)((sword_t)R(%d) >> (R(%d) & 0x1f))";
+      else return false;
+      // the division is still performed if rd is $zero, as NEMU does
+      if (rd || (f7 == 1 && f3 >= 4)) {
+        if (rd) emit_wreg(rd, fmt, rs1, rs2);
+        else { emit("(void)("); emit(fmt, rs1, rs2); emit(");"); }
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+static void translate_func(Func *f) {
+  cur = f;
+  fprintf(out, "\n// %s [0x%08x, 0x%08x)\n", f->name ? f->name : "(unnamed)", f->start, f->end);
+  fprintf(out, "static uint64_t aot_%08x(uint64_t budget) {\n", f->start);
+  fprintf(out, "  uint64_t cnt = 0;\n  switch (cpu.pc) {\n");
+  for (uint32_t pc = f->start; pc < f->end; pc += 4) {
+    fprintf(out, "    case 0x%08x: goto L_%08x;\n", pc, pc);
+  }
+  fprintf(out, "    default: return 0;\n  }\n");
+
+  int since_check = 0;
+  bool end_of_block = false;
+  for (uint32_t pc = f->start; pc < f->end; pc += 4) {
+    uint32_t i = fetch(pc);
+    fprintf(out, "L_%08x: ", pc);
+    if (since_check == CHECK_INTERVAL) {
+      fprintf(out, "if (cnt >= budget) { cpu.pc = 0x%08x; return cnt; } ", pc);
+      since_check = 0;
+    }
+    code_len = 0;
+    if (translate(pc, i, &end_of_block)) {
+      fprintf(out, "cnt ++; %s", code);
+    } else {
+      code_len = 0;
+      emit_exit(pc);
+      fprintf(out, "%s", code);
+      end_of_block = true;
+    }
+    fprintf(out, " // %08x\n", i);
+    if (end_of_block) since_check = 0;
+    else since_check ++;
+  }
+  if (!end_of_block) {
+    code_len = 0;
+    emit_exit(f->end);
+    fprintf(out, "  %s\n", code);
+  }
+  fprintf(out, "}\n");
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 3) {
+    fprintf(stderr, "Usage: %s <riscv32 ELF> <output C file>\n", argv[0]);
+    return 1;
+  }
+
+  FILE *fp = fopen(argv[1], "rb");
+  if (fp == NULL) { perror(argv[1]); return 1; }
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  elf = malloc(size);
+  assert(elf);
+  int ret = fread(elf, size, 1, fp);
+  assert(ret == 1);
+  fclose(fp);
+
+  Elf32_Ehdr *eh = (Elf32_Ehdr *)elf;
+  if (memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0 || eh->e_ident[EI_CLASS] != ELFCLASS32 ||
+      eh->e_machine != EM_RISCV) {
+    fprintf(stderr, "%s is not a riscv32 ELF\n", argv[1]);
+    return 1;
+  }
+
+  out = fopen(argv[2], "w");
+  if (out == NULL) { perror(argv[2]); return 1; }
+  fprintf(out, "// generated by riscv32-aot from %s, do not edit\n\n", argv[1]);
+  fprintf(out, "#include <cpu/aot.h>\n\n#define R(i) cpu.gpr[i]\n");
+
+  Elf32_Shdr *sh = (Elf32_Shdr *)(elf + eh->e_shoff);
+  int nr_inst = 0;
+  for (int i = 0; i < eh->e_shnum; i ++) {
+    if (sh[i].sh_type != SHT_PROGBITS || !(sh[i].sh_flags & SHF_EXECINSTR)) continue;
+    text = elf + sh[i].sh_offset;
+    text_start = sh[i].sh_addr;
+    text_end = sh[i].sh_addr + (sh[i].sh_size & ~0x3);
+    int first = nr_func;
+    collect_func(eh, &sh[i]);
+    for (int j = first; j < nr_func; j ++) {
+      translate_func(&func[j]);
+      fprintf(out, "static const uint32_t hash_%08x = 0x%08x;\n", func[j].start,
+          hash(func[j].start, func[j].end));
+    }
+    nr_inst += (text_end - text_start) / 4;
+  }
+
+  qsort(func, nr_func, sizeof(Func), cmp_addr);
+  fprintf(out, "\nconst AotFunc aot_func[] = {\n");
+  for (int i = 0; i < nr_func; i ++) {
+    fprintf(out, "  { 0x%08x, 0x%08x, aot_%08x, hash_%08x, \"%s\" },\n",
+        func[i].start, func[i].end, func[i].start, func[i].start, func[i].name ? func[i].name : "");
+  }
+  fprintf(out, "};\n\nconst int aot_nr_func = %d;\n", nr_func);
+  fclose(out);
+
+  printf("Translated %d functions, %d instructions\n", nr_func, nr_inst);
+  return 0;
+}
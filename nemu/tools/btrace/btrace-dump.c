@@ -0,0 +1,118 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+// Disassemble a binary instruction trace written by NEMU with --btrace,
+// see include/cpu/btrace.h for the format.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+#define MAGIC "NEMUBTRC"
+#define VERSION 1
+#define FLAG_REGS 0x1
+#define NR_GPR 32
+
+typedef struct {
+  char magic[8];
+  uint32_t version, flags;
+  char isa[16];
+} Header;
+
+static const char *regs[NR_GPR] = {
+  "$0", "ra", "sp", "gp", "tp", "t0", "t1", "t2",
+  "s0", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+  "a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7",
+  "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6"
+};
+
+void init_disasm(const char *triple);
+void disassemble(char *str, int size, uint64_t pc, uint8_t *code, int nbyte);
+
+static const char *file = NULL;
+
+static void __attribute__((noreturn)) fail(const char *msg) {
+  fprintf(stderr, "%s: %s\n", file, msg);
+  exit(1);
+}
+
+// return false at the end of the trace
+static bool read_or_fail(void *buf, size_t len, FILE *fp, bool eof_ok) {
+  size_t n = fread(buf, 1, len, fp);
+  if (n == len) return true;
+  if (n == 0 && eof_ok && feof(fp)) return false;
+  fail("unexpected end of file");
+}
+
+int main(int argc, char *argv[]) {
+  bool raw = false;
+  int i = 1;
+  if (i < argc && strcmp(argv[i], "-r") == 0) { raw = true; i ++; }
+  if (i + 1 != argc) {
+    fprintf(stderr, "Usage: %s [-r] TRACE\n", argv[0]);
+    fprintf(stderr, "\t-r  do not disassemble the instructions\n");
+    return 1;
+  }
+  file = argv[i];
+  FILE *fp = fopen(file, "rb");
+  if (fp == NULL) fail("can not open");
+  static char iobuf[1 << 20];
+  setvbuf(fp, iobuf, _IOFBF, sizeof(iobuf));
+
+  Header h;
+  read_or_fail(&h, sizeof(h), fp, false);
+  if (memcmp(h.magic, MAGIC, sizeof(h.magic)) != 0) fail("not a binary trace of NEMU");
+  if (h.version != VERSION) fail("unsupported version");
+  if (strncmp(h.isa, "riscv32", sizeof(h.isa)) != 0) fail("only riscv32 is supported");
+  bool has_regs = (h.flags & FLAG_REGS) != 0;
+
+  if (has_regs) {
+    uint32_t gpr[NR_GPR];
+    read_or_fail(gpr, sizeof(gpr), fp, false);
+    printf("initial registers:");
+    for (int r = 0; r < NR_GPR; r ++) printf("%s%s = 0x%08" PRIx32, r % 8 == 0 ? "\n  " : ", ", regs[r], gpr[r]);
+    printf("\n");
+  }
+
+  if (!raw) init_disasm("riscv32-pc-linux-gnu");
+  uint64_t nr = 0;
+  uint32_t rec[2];
+  while (read_or_fail(rec, sizeof(rec), fp, true)) {
+    uint32_t pc = rec[0], inst = rec[1];
+    char asm_buf[128] = "";
+    if (!raw) disassemble(asm_buf, sizeof(asm_buf), pc, (uint8_t *)&inst, 4);
+    printf("0x%08" PRIx32 ": %08" PRIx32 "  %-32s", pc, inst, asm_buf);
+    if (has_regs) {
+      uint8_t n;
+      read_or_fail(&n, 1, fp, false);
+      for (int k = 0; k < n; k ++) {
+        uint8_t r;
+        uint32_t val;
+        read_or_fail(&r, 1, fp, false);
+        read_or_fail(&val, 4, fp, false);
+        if (r >= NR_GPR) fail("corrupted trace");
+        printf(" %s = 0x%08" PRIx32, regs[r], val);
+      }
+    }
+    putchar('\n');
+    nr ++;
+  }
+  fprintf(stderr, "%" PRIu64 " instructions\n", nr);
+  fclose(fp);
+  return 0;
+}
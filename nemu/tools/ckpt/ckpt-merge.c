@@ -0,0 +1,147 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+// Merge a full checkpoint of NEMU and the chain of delta checkpoints saved
+// after it into one full checkpoint, see src/monitor/checkpoint.c.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <inttypes.h>
+
+#define PAGE_SIZE 4096
+#define PAGE_END 0xffffffffu
+
+typedef struct {
+  uint32_t version, cpu_size;
+  uint64_t mbase, msize;
+  char isa[16];
+} Header;
+
+static uint8_t *pmem = NULL;
+static Header hdr;
+static uint8_t *cpu = NULL;
+static uint64_t nr_inst = 0;
+static uint8_t *rest = NULL; // the sections after pmem, taken from the last checkpoint
+static long rest_size = 0;
+
+static void __attribute__((noreturn)) fail(const char *file, const char *msg) {
+  fprintf(stderr, "%s: %s\n", file, msg);
+  exit(1);
+}
+
+static void read_or_fail(void *buf, size_t len, FILE *fp, const char *file) {
+  if (fread(buf, len, 1, fp) != 1) fail(file, "unexpected end of file");
+}
+
+static void check_tag(FILE *fp, const char *file, const char *tag) {
+  char buf[8], expect[8] = {};
+  memcpy(expect, tag, strnlen(tag, sizeof(expect)));
+  read_or_fail(buf, sizeof(buf), fp, file);
+  if (memcmp(buf, expect, sizeof(buf)) != 0) fail(file, "corrupted checkpoint");
+}
+
+static void load(const char *file, bool first) {
+  FILE *fp = fopen(file, "rb");
+  if (fp == NULL) fail(file, "can not open");
+
+  char tag[8];
+  read_or_fail(tag, sizeof(tag), fp, file);
+  bool delta = (memcmp(tag, "NEMUDLTA", 8) == 0);
+  if (!delta && memcmp(tag, "NEMUCKPT", 8) != 0) fail(file, "not a checkpoint");
+  if (first == delta) fail(file, first ? "the first checkpoint must be a full one" : "not a delta checkpoint");
+
+  Header h;
+  read_or_fail(&h, sizeof(h), fp, file);
+  if (first) {
+    hdr = h;
+    pmem = calloc(1, hdr.msize);
+    cpu = malloc(hdr.cpu_size);
+    assert(pmem && cpu);
+  } else if (memcmp(&h, &hdr, sizeof(h)) != 0) {
+    fail(file, "the configuration is different from the first checkpoint");
+  }
+  if (delta) {
+    uint64_t parent;
+    read_or_fail(&parent, sizeof(parent), fp, file);
+    if (parent != nr_inst) fail(file, "not the next checkpoint of the chain");
+  }
+
+  check_tag(fp, file, "cpu");
+  read_or_fail(cpu, hdr.cpu_size, fp, file);
+  read_or_fail(&nr_inst, sizeof(nr_inst), fp, file);
+  check_tag(fp, file, "pmem");
+  while (true) {
+    uint32_t idx;
+    read_or_fail(&idx, sizeof(idx), fp, file);
+    if (idx == PAGE_END) break;
+    if ((uint64_t)idx * PAGE_SIZE >= hdr.msize) fail(file, "page out of the memory");
+    read_or_fail(pmem + (uint64_t)idx * PAGE_SIZE, PAGE_SIZE, fp, file);
+  }
+
+  // the device state is small and always saved in full
+  long pos = ftell(fp);
+  fseek(fp, 0, SEEK_END);
+  rest_size = ftell(fp) - pos;
+  fseek(fp, pos, SEEK_SET);
+  free(rest);
+  rest = malloc(rest_size);
+  assert(rest);
+  read_or_fail(rest, rest_size, fp, file);
+  fclose(fp);
+  printf("%s: instructions = %" PRIu64 "\n", file, nr_inst);
+}
+
+static bool page_is_zero(uint8_t *p) {
+  for (int i = 0; i < PAGE_SIZE; i ++) {
+    if (p[i] != 0) return false;
+  }
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    fprintf(stderr, "Usage: %s OUTPUT CKPT [DELTA...]\n", argv[0]);
+    return 1;
+  }
+  for (int i = 2; i < argc; i ++) load(argv[i], i == 2);
+
+  FILE *fp = fopen(argv[1], "wb");
+  if (fp == NULL) fail(argv[1], "can not open");
+  char tag[8] = "NEMUCKPT", sec[8] = {};
+  fwrite(tag, sizeof(tag), 1, fp);
+  fwrite(&hdr, sizeof(hdr), 1, fp);
+  memcpy(sec, "cpu", 3);
+  fwrite(sec, sizeof(sec), 1, fp);
+  fwrite(cpu, hdr.cpu_size, 1, fp);
+  fwrite(&nr_inst, sizeof(nr_inst), 1, fp);
+  memset(sec, 0, sizeof(sec));
+  memcpy(sec, "pmem", 4);
+  fwrite(sec, sizeof(sec), 1, fp);
+  for (uint32_t idx = 0; idx < hdr.msize / PAGE_SIZE; idx ++) {
+    uint8_t *p = pmem + (uint64_t)idx * PAGE_SIZE;
+    if (page_is_zero(p)) continue;
+    fwrite(&idx, sizeof(idx), 1, fp);
+    fwrite(p, PAGE_SIZE, 1, fp);
+  }
+  uint32_t end = PAGE_END;
+  fwrite(&end, sizeof(end), 1, fp);
+  fwrite(rest, rest_size, 1, fp);
+  if (fclose(fp) != 0) fail(argv[1], "write error");
+  return 0;
+}
@@ -0,0 +1,215 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+// Pick the representative intervals of a program from the basic-block
+// vectors written by NEMU with --bbv, as SimPoint does: the vectors are
+// normalized and randomly projected to a few dimensions, then clustered by
+// k-means. The number of clusters is the smallest one whose BIC score is
+// close enough to the best, and the interval nearest to the center of each
+// cluster represents it.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <inttypes.h>
+#include <math.h>
+#include <float.h>
+#include <unistd.h>
+
+#define DIM 15          // dimensions after the random projection
+#define NR_INIT 5       // k-means is run with this number of random initializations
+#define MAX_ITER 100
+#define BIC_THRESHOLD 0.9
+
+static double (*point)[DIM] = NULL;
+static int nr_point = 0;
+
+// the random projection of basic block `id' on dimension `d', in [-1, 1)
+static double proj(uint32_t id, int d) {
+  uint64_t x = (uint64_t)id * DIM + d + 0x9e3779b97f4a7c15ull;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  x ^= x >> 31;
+  return (x >> 11) * (2.0 / (1ull << 53)) - 1.0;
+}
+
+static void load(const char *file) {
+  FILE *fp = fopen(file, "r");
+  if (fp == NULL) { fprintf(stderr, "%s: can not open\n", file); exit(1); }
+  char *line = NULL;
+  size_t size = 0;
+  while (getline(&line, &size, fp) != -1) {
+    if (line[0] != 'T') continue;
+    point = realloc(point, sizeof(*point) * (nr_point + 1));
+    assert(point);
+    double *p = point[nr_point ++];
+    memset(p, 0, sizeof(*point));
+    // normalize the vector, so that intervals of different lengths are comparable
+    uint64_t total = 0, count;
+    uint32_t id;
+    int n;
+    for (char *s = line + 1; sscanf(s, ":%" SCNu32 ":%" SCNu64 " %n", &id, &count, &n) == 2; s += n) total += count;
+    for (char *s = line + 1; sscanf(s, ":%" SCNu32 ":%" SCNu64 " %n", &id, &count, &n) == 2; s += n) {
+      for (int d = 0; d < DIM; d ++) p[d] += (double)count / total * proj(id, d);
+    }
+  }
+  free(line);
+  fclose(fp);
+}
+
+static double dist2(const double *a, const double *b) {
+  double s = 0;
+  for (int d = 0; d < DIM; d ++) s += (a[d] - b[d]) * (a[d] - b[d]);
+  return s;
+}
+
+// return the sum of the squared distances to the centers
+static double kmeans(int k, int *label, double (*center)[DIM]) {
+  // start from random points, try a few times to avoid the same centers
+  for (int c = 0; c < k; c ++) {
+    int i = rand() % nr_point;
+    for (int retry = 0, j = 0; j < c && retry < 16; j ++) {
+      if (dist2(center[j], point[i]) == 0) { i = rand() % nr_point; j = -1; retry ++; }
+    }
+    memcpy(center[c], point[i], sizeof(*center));
+  }
+  for (int i = 0; i < nr_point; i ++) label[i] = -1;
+
+  double distortion = 0;
+  for (int iter = 0; iter < MAX_ITER; iter ++) {
+    bool changed = false;
+    distortion = 0;
+    for (int i = 0; i < nr_point; i ++) {
+      int best = 0;
+      double best_d = DBL_MAX;
+      for (int c = 0; c < k; c ++) {
+        double d = dist2(point[i], center[c]);
+        if (d < best_d) { best_d = d; best = c; }
+      }
+      if (label[i] != best) { label[i] = best; changed = true; }
+      distortion += best_d;
+    }
+    if (!changed) break;
+    for (int c = 0; c < k; c ++) {
+      double sum[DIM] = {};
+      int n = 0;
+      for (int i = 0; i < nr_point; i ++) {
+        if (label[i] != c) continue;
+        for (int d = 0; d < DIM; d ++) sum[d] += point[i][d];
+        n ++;
+      }
+      // an empty cluster keeps its center
+      if (n > 0) for (int d = 0; d < DIM; d ++) center[c][d] = sum[d] / n;
+    }
+  }
+  return distortion;
+}
+
+// the Bayesian information criterion of the clustering, as used by SimPoint
+static double bic(int k, const int *label, double distortion) {
+  double r = nr_point;
+  if (nr_point <= k) return 0;
+  double variance = distortion / (r - k);
+  if (variance <= 0) variance = DBL_MIN;
+  double loglike = 0;
+  for (int c = 0; c < k; c ++) {
+    double rn = 0;
+    for (int i = 0; i < nr_point; i ++) rn += (label[i] == c);
+    if (rn == 0) continue;
+    loglike += rn * log(rn) - rn * log(r) - rn / 2 * log(2 * M_PI * variance) * DIM - (rn - k) / 2;
+  }
+  double nr_param = (k - 1) + DIM * k + 1;
+  return loglike - nr_param / 2 * log(r);
+}
+
+static void write_result(const char *prefix, int k, const int *label, double (*center)[DIM]) {
+  char file[256];
+  snprintf(file, sizeof(file), "%s.simpoints", prefix);
+  FILE *fsp = fopen(file, "w");
+  snprintf(file, sizeof(file), "%s.weights", prefix);
+  FILE *fw = fopen(file, "w");
+  if (fsp == NULL || fw == NULL) { fprintf(stderr, "%s: can not write the result\n", prefix); exit(1); }
+  for (int c = 0, id = 0; c < k; c ++) {
+    int rep = -1, n = 0;
+    double best = DBL_MAX;
+    for (int i = 0; i < nr_point; i ++) {
+      if (label[i] != c) continue;
+      n ++;
+      double d = dist2(point[i], center[c]);
+      if (d < best) { best = d; rep = i; }
+    }
+    if (n == 0) continue;
+    fprintf(fsp, "%d %d\n", rep, id);
+    fprintf(fw, "%f %d\n", (double)n / nr_point, id);
+    printf("simpoint %d: interval %d, weight %f\n", id, rep, (double)n / nr_point);
+    id ++;
+  }
+  fclose(fsp);
+  fclose(fw);
+}
+
+int main(int argc, char *argv[]) {
+  int max_k = 10, seed = 1, o;
+  while ((o = getopt(argc, argv, "k:s:")) != -1) {
+    switch (o) {
+      case 'k': max_k = atoi(optarg); break;
+      case 's': seed = atoi(optarg); break;
+      default: goto usage;
+    }
+  }
+  if (argc - optind != 2 || max_k < 1) {
+usage:
+    fprintf(stderr, "Usage: %s [-k MAX_K] [-s SEED] BBV PREFIX\n", argv[0]);
+    fprintf(stderr, "write PREFIX.simpoints and PREFIX.weights in the format of SimPoint\n");
+    return 1;
+  }
+  load(argv[optind]);
+  if (nr_point == 0) { fprintf(stderr, "%s: no basic-block vector\n", argv[optind]); return 1; }
+  if (max_k > nr_point) max_k = nr_point;
+  srand(seed);
+
+  // the best clustering of each k
+  int (*label)[nr_point] = malloc(sizeof(int) * nr_point * max_k);
+  double (*center)[max_k][DIM] = malloc(sizeof(double) * max_k * max_k * DIM);
+  double *score = malloc(sizeof(double) * max_k);
+  int *tmp = malloc(sizeof(int) * nr_point);
+  double (*tmp_center)[DIM] = malloc(sizeof(double) * max_k * DIM);
+  assert(label && center && score && tmp && tmp_center);
+  double min_score = DBL_MAX, max_score = -DBL_MAX;
+  for (int k = 1; k <= max_k; k ++) {
+    double best = DBL_MAX;
+    for (int t = 0; t < NR_INIT; t ++) {
+      double d = kmeans(k, tmp, tmp_center);
+      if (d < best) {
+        best = d;
+        memcpy(label[k - 1], tmp, sizeof(int) * nr_point);
+        memcpy(center[k - 1], tmp_center, sizeof(double) * k * DIM);
+      }
+    }
+    score[k - 1] = bic(k, label[k - 1], best);
+    if (score[k - 1] < min_score) min_score = score[k - 1];
+    if (score[k - 1] > max_score) max_score = score[k - 1];
+    printf("k = %d, BIC = %f\n", k, score[k - 1]);
+  }
+
+  int k = 1;
+  while (k < max_k && score[k - 1] < min_score + BIC_THRESHOLD * (max_score - min_score)) k ++;
+  printf("intervals = %d, clusters = %d\n", nr_point, k);
+  write_result(argv[optind + 1], k, label[k - 1], center[k - 1]);
+  return 0;
+}